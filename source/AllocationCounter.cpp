@@ -0,0 +1,69 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include "AllocationCounter.h"
+
+static thread_local AllocationCounter::Counts counts = { 0, 0 };
+static thread_local AllocationCounter::Phase phase = AllocationCounter::IDLE;
+static thread_local AllocationCounter::PhaseCounts phases[AllocationCounter::PHASES] = {};
+
+void AllocationCounter::OnAllocation(std::size_t bytes)
+{
+	counts.allocations++;
+	counts.bytes += bytes;
+	phases[phase].allocations++;
+	phases[phase].bytes += bytes;
+}
+
+AllocationCounter::Counts AllocationCounter::Get()
+{
+	return counts;
+}
+
+AllocationCounter::Counts AllocationCounter::Since(const Counts& snapshot)
+{
+	Counts ret = { counts.allocations - snapshot.allocations, counts.bytes - snapshot.bytes };
+	return ret;
+}
+
+void AllocationCounter::SetPhase(Phase newPhase)
+{
+	phase = newPhase;
+}
+
+void AllocationCounter::OnCharacter()
+{
+	phases[phase].characters++;
+}
+
+void AllocationCounter::OnFrame()
+{
+	phases[phase].frames++;
+}
+
+AllocationCounter::PhaseCounts AllocationCounter::GetPhase(Phase which)
+{
+	return phases[which];
+}
+
+const char* AllocationCounter::GetPhaseName(Phase which)
+{
+	static const char* names[PHASES] = { "idle", "ATR", "PPS", "transmission" };
+	return names[which];
+}
+
+void AllocationCounter::ResetPhases()
+{
+	for (int i = 0; i < PHASES; i++)
+	{
+		phases[i] = PhaseCounts();
+	}
+	phase = IDLE;
+}
@@ -0,0 +1,74 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstddef>
+#include <LogicPublicTypes.h>
+
+// Heap allocations made by the calling thread. They are counted only in programs linking
+// tools/AllocationHooks.cpp, which replaces the global operator new; the analyzer never counts.
+//
+// Built with ISO7816_ALLOCATION_ACCOUNTING the decoder also tells the phase it is in, so allocations
+// are put down to the phase together with the characters decoded and the frames emitted in it.
+class AllocationCounter
+{
+public:
+	struct Counts
+	{
+		U64 allocations;
+		U64 bytes;
+	};
+
+	enum Phase
+	{
+		IDLE,			// looking for resets, bit timing
+		ATR,
+		PPS,
+		TRANSMISSION,
+		PHASES
+	};
+
+	struct PhaseCounts
+	{
+		U64 allocations;
+		U64 bytes;
+		U64 characters;
+		U64 frames;
+	};
+
+	static void OnAllocation(std::size_t bytes);
+	static Counts Get();
+	// allocations since the snapshot
+	static Counts Since(const Counts& snapshot);
+
+	static void SetPhase(Phase phase);
+	static void OnCharacter();
+	static void OnFrame();
+	static PhaseCounts GetPhase(Phase phase);
+	static const char* GetPhaseName(Phase phase);
+	static void ResetPhases();
+
+private:
+	AllocationCounter();
+};
+
+#ifdef ISO7816_ALLOCATION_ACCOUNTING
+#define ALLOCATION_PHASE(phase) AllocationCounter::SetPhase(AllocationCounter::phase)
+#define ALLOCATION_CHARACTER() AllocationCounter::OnCharacter()
+#define ALLOCATION_FRAME() AllocationCounter::OnFrame()
+#else
+#define ALLOCATION_PHASE(phase)
+#define ALLOCATION_CHARACTER()
+#define ALLOCATION_FRAME()
+#endif //ISO7816_ALLOCATION_ACCOUNTING
+
+#endif //ALLOCATION_COUNTER_H
@@ -0,0 +1,95 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include <algorithm>
+#include "ChannelSource.h"
+#include "Exceptions.hpp"
+
+EdgeChannelSource::ptr EdgeChannelSource::factory(BitState initial, const U64* edges, std::size_t count, U64 lastSample)
+{
+	EdgeChannelSource::ptr ret(new EdgeChannelSource(initial, edges, count, lastSample));
+	return ret;
+}
+
+EdgeChannelSource::ptr EdgeChannelSource::factory(BitState initial, std::vector<U64> edges, U64 lastSample)
+{
+	EdgeChannelSource::ptr ret(new EdgeChannelSource(initial, nullptr, 0, lastSample));
+	ret->_storage = std::move(edges);
+	ret->_edges = ret->_storage.data();
+	ret->_count = ret->_storage.size();
+	return ret;
+}
+
+EdgeChannelSource::EdgeChannelSource(BitState initial, const U64* edges, std::size_t count, U64 lastSample)
+{
+	_initial = initial;
+	_edges = edges;
+	_count = count;
+	_lastSample = lastSample;
+}
+
+U64 EdgeChannelSource::GetSampleNumber()
+{
+	return _sample;
+}
+
+BitState EdgeChannelSource::GetBitState()
+{
+	// levels alternate from the initial one
+	return ((_next & 1) == 0) == (_initial == BIT_HIGH) ? BIT_HIGH : BIT_LOW;
+}
+
+U32 EdgeChannelSource::AdvanceToAbsPosition(U64 sample)
+{
+	if (sample > _lastSample)
+	{
+		throw EndOfDataException(sample);
+	}
+	if (sample < _sample)
+	{
+		return 0;
+	}
+
+	const U64* next = std::upper_bound(_edges + _next, _edges + _count, sample);
+	std::size_t crossed = (next - _edges) - _next;
+	_next += crossed;
+	_sample = sample;
+	return static_cast<U32>(crossed);
+}
+
+void EdgeChannelSource::AdvanceToNextEdge()
+{
+	CheckNextEdge();
+	_sample = _edges[_next++];
+}
+
+U64 EdgeChannelSource::GetSampleOfNextEdge()
+{
+	CheckNextEdge();
+	return _edges[_next];
+}
+
+bool EdgeChannelSource::WouldAdvancingToAbsPositionCauseTransition(U64 sample)
+{
+	return _next < _count && _edges[_next] <= sample;
+}
+
+bool EdgeChannelSource::DoMoreTransitionsExistInCurrentData()
+{
+	return _next < _count;
+}
+
+void EdgeChannelSource::CheckNextEdge()
+{
+	if (_next >= _count)
+	{
+		throw EndOfDataException(_sample);
+	}
+}
@@ -0,0 +1,73 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef CHANNEL_SOURCE_H
+#define CHANNEL_SOURCE_H
+
+#include <memory>
+#include <vector>
+#include <LogicPublicTypes.h>
+
+// A forward-only cursor over the edges of one line, as much of AnalyzerChannelData as the decoder needs.
+// The decoder reads the lines through it, so it runs in Logic as well as on recorded edges.
+class ChannelSource
+{
+public:
+	typedef std::shared_ptr<ChannelSource> ptr;
+
+	virtual ~ChannelSource()
+	{
+	}
+
+	virtual U64 GetSampleNumber() = 0;
+	virtual BitState GetBitState() = 0;
+	// returns the number of edges crossed
+	virtual U32 AdvanceToAbsPosition(U64 sample) = 0;
+	virtual void AdvanceToNextEdge() = 0;
+	virtual U64 GetSampleOfNextEdge() = 0;
+	virtual bool WouldAdvancingToAbsPositionCauseTransition(U64 sample) = 0;
+	virtual bool DoMoreTransitionsExistInCurrentData() = 0;
+};
+
+// Edges recorded in an array, in memory or mapped from a file. The SDK waits for more data at the end
+// of the capture, here moving past the last sample throws EndOfDataException.
+class EdgeChannelSource : public ChannelSource
+{
+public:
+	typedef std::shared_ptr<EdgeChannelSource> ptr;
+
+	// the array has to outlive the source
+	static EdgeChannelSource::ptr factory(BitState initial, const U64* edges, std::size_t count, U64 lastSample);
+	static EdgeChannelSource::ptr factory(BitState initial, std::vector<U64> edges, U64 lastSample);
+
+	virtual U64 GetSampleNumber();
+	virtual BitState GetBitState();
+	virtual U32 AdvanceToAbsPosition(U64 sample);
+	virtual void AdvanceToNextEdge();
+	virtual U64 GetSampleOfNextEdge();
+	virtual bool WouldAdvancingToAbsPositionCauseTransition(U64 sample);
+	virtual bool DoMoreTransitionsExistInCurrentData();
+
+protected:
+	EdgeChannelSource(BitState initial, const U64* edges, std::size_t count, U64 lastSample);
+
+	void CheckNextEdge();
+
+	BitState _initial;
+	const U64* _edges;
+	std::size_t _count;
+	U64 _lastSample;
+	std::vector<U64> _storage;
+
+	U64 _sample = 0;
+	std::size_t _next = 0;		// edges before it are behind the cursor
+};
+
+#endif //CHANNEL_SOURCE_H
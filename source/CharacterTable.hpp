@@ -0,0 +1,89 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef CHARACTER_TABLE_HPP
+#define CHARACTER_TABLE_HPP
+
+// Decodes a character as seen on I/O (8 data bits followed by the parity bit, first received is MSB)
+// with a single lookup. There is one table per convention, both are built at compile time.
+class CharacterTable
+{
+public:
+	static const int SIZE = 512;
+
+	struct Entry
+	{
+		unsigned char value;	// decoded byte
+		bool parity;			// true when the parity bit is correct
+	};
+
+	constexpr CharacterTable(bool inverse) : _entries{}
+	{
+		for (int line = 0; line < SIZE; line++)
+		{
+			// in inverse convention state L encodes 1 and the most significant bit is sent first,
+			// in direct convention state H encodes 1 and the least significant bit is sent first
+			unsigned int bits = inverse ? (~line & (SIZE - 1)) : line;
+			unsigned int data = bits >> 1;
+			_entries[line].value = static_cast<unsigned char>(inverse ? data : Reverse(data));
+			// the number of 1s in data and parity bits shall be even
+			_entries[line].parity = (Ones(bits) & 1) == 0;
+		}
+	}
+
+	constexpr const Entry& operator[](unsigned short line) const
+	{
+		return _entries[line & (SIZE - 1)];
+	}
+
+	static const CharacterTable& Direct();
+	static const CharacterTable& Inverse();
+
+protected:
+	static constexpr unsigned int Reverse(unsigned int val)
+	{
+		unsigned int ret = 0;
+		for (int i = 0; i < 8; i++)
+		{
+			ret = (ret << 1) | ((val >> i) & 1);
+		}
+		return ret;
+	}
+
+	static constexpr unsigned int Ones(unsigned int val)
+	{
+		unsigned int ret = 0;
+		for (; val != 0; val >>= 1)
+		{
+			ret += val & 1;
+		}
+		return ret;
+	}
+
+	Entry _entries[SIZE];
+};
+
+inline const CharacterTable& CharacterTable::Direct()
+{
+	static constexpr CharacterTable table(false);
+	return table;
+}
+
+inline const CharacterTable& CharacterTable::Inverse()
+{
+	static constexpr CharacterTable table(true);
+	return table;
+}
+
+// TS character: 'DC' followed by H on the line is '3B', 'C0' followed by H is '3F'
+static_assert(CharacterTable(false)[0x1B9].value == 0x3B && CharacterTable(false)[0x1B9].parity, "direct convention TS");
+static_assert(CharacterTable(true)[0x181].value == 0x3F && CharacterTable(true)[0x181].parity, "inverse convention TS");
+
+#endif //CHARACTER_TABLE_HPP
@@ -0,0 +1,130 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include <cmath>
+#include "ClockIndex.h"
+
+ClockIndex::ClockIndex()
+{
+	Clear();
+}
+
+ClockIndex::~ClockIndex()
+{
+}
+
+void ClockIndex::Add(u64 start, u64 end, u64 edges)
+{
+	if (end <= start) return;
+
+	if (!_anchored || _pending.GetEnd() != start)
+	{
+		// the phase of the clock is unknown, wait for the next edge
+		Restart(end, false);
+		return;
+	}
+
+	const Segment* ref = GetReference();
+	if (ref != nullptr && !Matches(*ref, end - start, edges))
+	{
+		// clock stopped or the period changed, the index has to be learned again edge by edge
+		Restart(end, false);
+		_stale = true;
+		return;
+	}
+
+	_pending.samples += end - start;
+	_pending.edges += edges;
+
+	if (_pending.edges >= MIN_SEGMENT_EDGES)
+	{
+		Commit();
+	}
+}
+
+void ClockIndex::AddEdge(u64 from, u64 pos)
+{
+	Add(from, pos, 1);
+	if (!_anchored)
+	{
+		// the stretch before the first edge says nothing about the period, measure from here
+		Restart(pos, true);
+	}
+}
+
+void ClockIndex::Clear()
+{
+	_segments.clear();
+	_stale = false;
+	Restart(0, false);
+}
+
+ClockIndex::u64 ClockIndex::EstimateSamples(u64 edges) const
+{
+	const Segment* ref = GetReference();
+	if (ref == nullptr) return 0;
+	return static_cast<u64>((static_cast<double>(ref->samples) * edges) / ref->edges);
+}
+
+double ClockIndex::GetSamplesPerEdge() const
+{
+	const Segment* ref = GetReference();
+	if (ref == nullptr) return 0.0;
+	return static_cast<double>(ref->samples) / ref->edges;
+}
+
+const ClockIndex::Segment* ClockIndex::GetReference() const
+{
+	if (_stale || _segments.empty()) return nullptr;
+	return &_segments.back();
+}
+
+void ClockIndex::Commit()
+{
+	if (!_segments.empty() && _segments.back().GetEnd() == _pending.start && SamePeriod(_segments.back(), _pending))
+	{
+		_segments.back().samples += _pending.samples;
+		_segments.back().edges += _pending.edges;
+	}
+	else
+	{
+		if (_segments.size() >= MAX_SEGMENTS)
+		{
+			_segments.erase(_segments.begin(), _segments.begin() + MAX_SEGMENTS / 2);
+		}
+		_segments.push_back(_pending);
+	}
+
+	_stale = false;
+	Restart(_pending.GetEnd(), _anchored);
+}
+
+void ClockIndex::Restart(u64 pos, bool anchored)
+{
+	_pending.start = pos;
+	_pending.samples = 0;
+	_pending.edges = 0;
+	_anchored = anchored;
+}
+
+bool ClockIndex::SamePeriod(const Segment& a, const Segment& b)
+{
+	// +/- 1/16 of the period, enough to absorb sampling jitter
+	double pa = a.GetPeriod();
+	double pb = b.GetPeriod();
+	return std::fabs(pa - pb) * 16.0 <= pa;
+}
+
+bool ClockIndex::Matches(const Segment& ref, u64 samples, u64 edges)
+{
+	// two edges of slack for the stretch not starting/ending on an edge
+	double expected = (static_cast<double>(samples) * ref.edges) / ref.samples;
+	return std::fabs(expected - edges) <= 2.0 + expected / 16.0;
+}
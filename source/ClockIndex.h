@@ -0,0 +1,78 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef CLOCK_INDEX_H
+#define CLOCK_INDEX_H
+
+#include <vector>
+
+// Run-length description of the CLK line. Every segment covers a stretch of the capture where the clock
+// runs with a stable period, so the number of samples needed for N clock edges can be predicted without
+// visiting each of them.
+class ClockIndex
+{
+public:
+	typedef unsigned long long int u64;
+
+	struct Segment
+	{
+		u64 start;		// first sample of the run
+		u64 samples;	// length of the run in samples
+		u64 edges;		// CLK edges (half cycles) seen within the run
+
+		u64 GetEnd() const
+		{
+			return start + samples;
+		}
+		u64 GetCycles() const
+		{
+			return edges / 2;
+		}
+		double GetPeriod() const
+		{
+			return edges ? (2.0 * samples) / edges : 0.0;
+		}
+	};
+
+	// segments shorter than this are kept pending, single edges are too much affected by sampling
+	static const u64 MIN_SEGMENT_EDGES = 16;
+	// only the most recent history is kept
+	static const std::size_t MAX_SEGMENTS = 1024;
+
+public:
+	ClockIndex();
+	virtual ~ClockIndex();
+
+	void Add(u64 start, u64 end, u64 edges);
+	void AddEdge(u64 from, u64 pos);
+	void Clear();
+
+	u64 EstimateSamples(u64 edges) const;
+	double GetSamplesPerEdge() const;
+	const std::vector<Segment>& GetSegments() const
+	{
+		return _segments;
+	}
+
+protected:
+	const Segment* GetReference() const;
+	void Commit();
+	void Restart(u64 pos, bool anchored);
+	static bool SamePeriod(const Segment& a, const Segment& b);
+	static bool Matches(const Segment& ref, u64 samples, u64 edges);
+
+protected:
+	std::vector<Segment> _segments;
+	Segment _pending;
+	bool _anchored;
+	bool _stale;
+};
+
+#endif //CLOCK_INDEX_H
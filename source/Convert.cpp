@@ -61,6 +61,13 @@ std::string Convert::ToDec(int val)
 	return tmp.str();
 }
 
+std::string Convert::ToDec(double val, int precision)
+{
+	std::ostringstream tmp;
+	tmp << std::fixed << std::setprecision(precision) << val;
+	return tmp.str();
+}
+
 static const unsigned char msb2lsb[] =
 {
 	0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
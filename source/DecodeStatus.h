@@ -0,0 +1,50 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef DECODE_STATUS_H
+#define DECODE_STATUS_H
+
+// Outcome of a decoder step. Conditions found in the signal are returned rather than thrown,
+// on success the position is where the step ended, otherwise where the condition was found.
+struct DecodeStatus
+{
+	enum Code
+	{
+		OK = 0,
+		RESET,			// RST changed
+		OUT_OF_SYNC,
+		PARITY,
+		ERROR_SIGNAL,	// I/O is LOW in the guard time
+		GUARD_TIME,		// a character starts before the guard time of the previous one is over
+		INVALID_TS
+	};
+
+	Code code;
+	unsigned long long int position;
+
+	static DecodeStatus Ok(unsigned long long int pos)
+	{
+		DecodeStatus ret = { OK, pos };
+		return ret;
+	}
+
+	static DecodeStatus Failure(Code code, unsigned long long int pos)
+	{
+		DecodeStatus ret = { code, pos };
+		return ret;
+	}
+
+	bool Failed() const
+	{
+		return code != OK;
+	}
+};
+
+#endif //DECODE_STATUS_H
@@ -10,10 +10,26 @@
 #ifndef DEFINITIONS_HPP
 #define DEFINITIONS_HPP
 
+// default ETU: Fd / Dd = 372 / 1 clock cycles
+#define DEF_ETU 372
 // +/- 5%
 #define DEF_ETU_MIN 354
 #define DEF_ETU_MAX 390
 
+// CLK is probed after reset, below these values it is not reliable
+#define CLK_PROBE_CYCLES 64
+#define MIN_SAMPLES_PER_CLK 4
+#define MIN_CLK_REGULARITY 90
+
+// minimum delay between leading edges of two characters in ETU, T=1 allows 11 (N = 255)
+#define CHARACTER_GUARD_ETU 12
+#define T1_CHARACTER_GUARD_ETU 11
+
+// character framing found on I/O without TS: characters in a row to lock on, edges kept while searching
+#define LOCK_CHARACTERS 4
+#define LOCK_MIN_EDGES 32
+#define LOCK_MAX_EDGES 512
+
 #define PPS_HEADER 0xff
 #define PPS0_1 0x10
 #define PPS0_2 0x20
@@ -0,0 +1,403 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include "EdgeCapture.h"
+#include "Exceptions.hpp"
+#include "Logging.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif //_WIN32
+
+static_assert(sizeof(EdgeCapture::Header) == 40, "capture header layout");
+static_assert(sizeof(EdgeCapture::LineHeader) == 40, "capture line header layout");
+static_assert(sizeof(EdgeCapture::BlockIndex) == 16, "capture block index layout");
+
+static U64 CountBlocks(U64 edges, U32 edgesPerBlock)
+{
+	return (edges + edgesPerBlock - 1) / edgesPerBlock;
+}
+
+static bool CopySpill(FILE* spill, FILE* file)
+{
+	std::vector<U8> buffer(1 << 20);
+	rewind(spill);
+	for (; ; )
+	{
+		size_t read = fread(buffer.data(), 1, buffer.size(), spill);
+		if (read > 0 && fwrite(buffer.data(), read, 1, file) != 1) return false;
+		if (read < buffer.size()) return ferror(spill) == 0;
+	}
+}
+
+EdgeCaptureWriter::ptr EdgeCaptureWriter::factory(U64 sampleRate)
+{
+	EdgeCaptureWriter::ptr ret(new EdgeCaptureWriter(sampleRate));
+	return ret;
+}
+
+EdgeCaptureWriter::EdgeCaptureWriter(U64 sampleRate)
+{
+	_sampleRate = sampleRate;
+	for (LineData& line : _lines)
+	{
+		line.present = false;
+		line.initial = BIT_LOW;
+		line.edges = 0;
+		line.lastEdge = 0;
+		line.size = 0;
+		line.spill = nullptr;
+	}
+}
+
+EdgeCaptureWriter::~EdgeCaptureWriter()
+{
+	for (LineData& line : _lines)
+	{
+		if (line.spill != nullptr)
+		{
+			fclose(line.spill);
+		}
+	}
+}
+
+void EdgeCaptureWriter::SetInitialState(EdgeCapture::Line line, BitState state)
+{
+	_lines[line].present = true;
+	_lines[line].initial = state;
+}
+
+void EdgeCaptureWriter::AddEdge(EdgeCapture::Line line, U64 sample)
+{
+	LineData& data = _lines[line];
+	if (data.edges > 0 && sample <= data.lastEdge)
+	{
+		throw std::invalid_argument("Edges have to be added in ascending order");
+	}
+	data.present = true;
+	if (data.edges % EdgeCapture::EDGES_PER_BLOCK == 0)
+	{
+		EdgeCapture::BlockIndex block = { data.lastEdge, data.size };
+		data.index.push_back(block);
+	}
+
+	// LEB128, 7 bits a byte starting with the lowest ones
+	U64 delta = sample - data.lastEdge;
+	do
+	{
+		U8 byte = delta & 0x7f;
+		delta >>= 7;
+		data.data.push_back(delta ? (byte | 0x80) : byte);
+		data.size++;
+	} while (delta);
+
+	data.lastEdge = sample;
+	data.edges++;
+	if (data.data.size() >= SPILL_BYTES)
+	{
+		Spill(data);
+	}
+}
+
+bool EdgeCaptureWriter::Spill(LineData& line)
+{
+	if (line.data.empty() || _failed) return !_failed;
+	if (line.spill == nullptr)
+	{
+		line.spill = tmpfile();
+	}
+	if (line.spill == nullptr || fwrite(line.data.data(), line.data.size(), 1, line.spill) != 1)
+	{
+		LOG_ERROR("Cannot write a temporary file of the capture");
+		_failed = true;
+	}
+	// dropped either way, the capture cannot be written anymore after a failure
+	line.data.clear();
+	return !_failed;
+}
+
+bool EdgeCaptureWriter::Write(const std::string& path, U64 lastSample)
+{
+	for (LineData& line : _lines)
+	{
+		if (line.spill != nullptr)
+		{
+			Spill(line);
+		}
+	}
+	if (_failed) return false;
+
+	EdgeCapture::Header header;
+	memcpy(header.magic, EdgeCapture::MAGIC, sizeof(header.magic));
+	header.version = EdgeCapture::VERSION;
+	header.lines = EdgeCapture::LINES;
+	header.sampleRate = _sampleRate;
+	header.lastSample = lastSample;
+	header.edgesPerBlock = EdgeCapture::EDGES_PER_BLOCK;
+	header.reserved = 0;
+
+	// deltas right after the headers, the block index of a line aligned after its deltas
+	EdgeCapture::LineHeader lines[EdgeCapture::LINES];
+	U64 offset = sizeof(header) + sizeof(lines);
+	for (int i = 0; i < EdgeCapture::LINES; i++)
+	{
+		memset(&lines[i], 0, sizeof(lines[i]));
+		lines[i].present = _lines[i].present ? 1 : 0;
+		lines[i].initial = static_cast<U8>(_lines[i].initial);
+		lines[i].edges = _lines[i].edges;
+		lines[i].dataOffset = offset;
+		lines[i].dataSize = _lines[i].size;
+		offset = (offset + lines[i].dataSize + 7) & ~7ULL;
+		lines[i].indexOffset = offset;
+		offset += _lines[i].index.size() * sizeof(EdgeCapture::BlockIndex);
+	}
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+	{
+		LOG_ERROR("Cannot create capture: %s", path.c_str());
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(lines, sizeof(lines), 1, file) == 1;
+	static const U8 padding[8] = { 0 };
+	for (int i = 0; i < EdgeCapture::LINES && written; i++)
+	{
+		const LineData& line = _lines[i];
+		U64 pad = lines[i].indexOffset - lines[i].dataOffset - lines[i].dataSize;
+		written = (line.spill == nullptr || CopySpill(line.spill, file)) &&
+			(line.data.empty() || fwrite(line.data.data(), line.data.size(), 1, file) == 1) &&
+			(pad == 0 || fwrite(padding, static_cast<size_t>(pad), 1, file) == 1) &&
+			(line.index.empty() || fwrite(line.index.data(), line.index.size() * sizeof(EdgeCapture::BlockIndex), 1, file) == 1);
+	}
+	written = (fclose(file) == 0) && written;
+	if (!written)
+	{
+		LOG_ERROR("Cannot write capture: %s", path.c_str());
+	}
+	return written;
+}
+
+EdgeCaptureFile::ptr EdgeCaptureFile::factory(const std::string& path)
+{
+	EdgeCaptureFile::ptr ret(new EdgeCaptureFile());
+	if (!ret->Map(path) || !ret->Validate())
+	{
+		LOG_ERROR("Not a readable capture: %s", path.c_str());
+		return EdgeCaptureFile::ptr();
+	}
+	return ret;
+}
+
+EdgeCaptureFile::EdgeCaptureFile()
+{
+	memset(&_header, 0, sizeof(_header));
+	memset(_lines, 0, sizeof(_lines));
+}
+
+EdgeCaptureFile::~EdgeCaptureFile()
+{
+#ifdef _WIN32
+	if (_data != nullptr) UnmapViewOfFile(_data);
+	if (_mapping != nullptr) CloseHandle(_mapping);
+	if (_file != nullptr) CloseHandle(_file);
+#else
+	if (_data != nullptr) munmap(const_cast<U8*>(_data), static_cast<size_t>(_size));
+	if (_file >= 0) close(_file);
+#endif //_WIN32
+}
+
+bool EdgeCaptureFile::Map(const std::string& path)
+{
+	// pages are read as the cursors get to them, nothing is loaded up front
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	_file = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return false;
+	_size = static_cast<U64>(size.QuadPart);
+	_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping == nullptr) return false;
+	_data = static_cast<const U8*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+	return _data != nullptr;
+#else
+	_file = open(path.c_str(), O_RDONLY);
+	if (_file < 0) return false;
+	struct stat st;
+	if (fstat(_file, &st) != 0 || st.st_size == 0) return false;
+	_size = static_cast<U64>(st.st_size);
+	void* data = mmap(nullptr, static_cast<size_t>(_size), PROT_READ, MAP_PRIVATE, _file, 0);
+	if (data == MAP_FAILED) return false;
+	madvise(data, static_cast<size_t>(_size), MADV_SEQUENTIAL);
+	_data = static_cast<const U8*>(data);
+	return true;
+#endif //_WIN32
+}
+
+bool EdgeCaptureFile::Validate()
+{
+	if (_size < sizeof(_header) + sizeof(_lines)) return false;
+	memcpy(&_header, _data, sizeof(_header));
+	memcpy(_lines, _data + sizeof(_header), sizeof(_lines));
+
+	if (memcmp(_header.magic, EdgeCapture::MAGIC, sizeof(_header.magic)) != 0) return false;
+	if (_header.version != EdgeCapture::VERSION || _header.lines != EdgeCapture::LINES || _header.edgesPerBlock == 0) return false;
+
+	for (const EdgeCapture::LineHeader& line : _lines)
+	{
+		if (!line.present) continue;
+		U64 indexSize = CountBlocks(line.edges, _header.edgesPerBlock) * sizeof(EdgeCapture::BlockIndex);
+		if (line.dataOffset > _size || line.dataSize > _size - line.dataOffset) return false;
+		if (line.indexOffset % 8 != 0 || line.indexOffset > _size || indexSize > _size - line.indexOffset) return false;
+		if (line.initial > BIT_HIGH) return false;
+	}
+	return true;
+}
+
+ChannelSource::ptr EdgeCaptureFile::OpenLine(EdgeCapture::Line line)
+{
+	if (!HasLine(line))
+	{
+		return ChannelSource::ptr();
+	}
+	ChannelSource::ptr ret(new EdgeCaptureChannel(shared_from_this(), _lines[line], _header.lastSample, _header.edgesPerBlock, _data));
+	return ret;
+}
+
+EdgeCaptureChannel::EdgeCaptureChannel(EdgeCaptureFile::ptr file, const EdgeCapture::LineHeader& line, U64 lastSample, U32 edgesPerBlock, const U8* data)
+{
+	_file = file;
+	_begin = data + line.dataOffset;
+	_end = _begin + line.dataSize;
+	_index = reinterpret_cast<const EdgeCapture::BlockIndex*>(data + line.indexOffset);
+	_blocks = CountBlocks(line.edges, edgesPerBlock);
+	_edgesPerBlock = edgesPerBlock;
+	_initial = static_cast<BitState>(line.initial);
+	_edges = line.edges;
+	_lastSample = lastSample;
+
+	_read = _begin;
+	if (_edges > 0)
+	{
+		JumpToBlock(0);
+	}
+}
+
+U64 EdgeCaptureChannel::GetSampleNumber()
+{
+	return _sample;
+}
+
+BitState EdgeCaptureChannel::GetBitState()
+{
+	// levels alternate from the initial one
+	return ((_next & 1) == 0) == (_initial == BIT_HIGH) ? BIT_HIGH : BIT_LOW;
+}
+
+U32 EdgeCaptureChannel::AdvanceToAbsPosition(U64 sample)
+{
+	if (sample > _lastSample)
+	{
+		throw EndOfDataException(sample);
+	}
+	if (sample < _sample)
+	{
+		return 0;
+	}
+
+	// whole blocks behind the position are not decoded
+	U64 crossed = 0;
+	while (_next < _edges)
+	{
+		U64 block = _next / _edgesPerBlock;
+		if (block + 1 >= _blocks || _index[block + 1].edgeBefore > sample)
+		{
+			break;
+		}
+		crossed += (block + 1) * _edgesPerBlock - _next;
+		JumpToBlock(block + 1);
+	}
+	while (_next < _edges && _nextEdge <= sample)
+	{
+		crossed++;
+		ReadNextEdge();
+	}
+	_sample = sample;
+	return static_cast<U32>(crossed);
+}
+
+void EdgeCaptureChannel::AdvanceToNextEdge()
+{
+	if (_next >= _edges)
+	{
+		throw EndOfDataException(_sample);
+	}
+	_sample = _nextEdge;
+	ReadNextEdge();
+}
+
+U64 EdgeCaptureChannel::GetSampleOfNextEdge()
+{
+	if (_next >= _edges)
+	{
+		throw EndOfDataException(_sample);
+	}
+	return _nextEdge;
+}
+
+bool EdgeCaptureChannel::WouldAdvancingToAbsPositionCauseTransition(U64 sample)
+{
+	return _next < _edges && _nextEdge <= sample;
+}
+
+bool EdgeCaptureChannel::DoMoreTransitionsExistInCurrentData()
+{
+	return _next < _edges;
+}
+
+void EdgeCaptureChannel::ReadNextEdge()
+{
+	// edge _next is passed, the delta of the one after it follows
+	_next++;
+	if (_next >= _edges)
+	{
+		return;
+	}
+
+	U64 delta = 0;
+	for (int shift = 0; ; shift += 7)
+	{
+		if (_read >= _end || shift > 63)
+		{
+			throw std::runtime_error("Corrupted capture");
+		}
+		U8 byte = *_read++;
+		delta |= static_cast<U64>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) break;
+	}
+	_nextEdge += delta;
+}
+
+void EdgeCaptureChannel::JumpToBlock(U64 block)
+{
+	// as if the edge before the block was just passed
+	_next = block * _edgesPerBlock - 1;
+	_nextEdge = _index[block].edgeBefore;
+	_read = _begin + _index[block].dataOffset;
+	ReadNextEdge();
+}
@@ -0,0 +1,191 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef EDGE_CAPTURE_H
+#define EDGE_CAPTURE_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <LogicPublicTypes.h>
+#include "ChannelSource.h"
+
+// Binary capture of the four lines for decoding offline. Every line keeps its edges as LEB128
+// deltas from the previous edge, with an index of blocks to jump over them. Little endian.
+//
+//   Header, four LineHeaders in Line order,
+//   per line: the deltas, then one BlockIndex entry per EDGES_PER_BLOCK edges
+namespace EdgeCapture
+{
+	enum Line
+	{
+		VCC_LINE,
+		RST_LINE,
+		CLK_LINE,
+		IO_LINE,
+		LINES
+	};
+
+	static const char MAGIC[8] = { 'I', 'S', 'O', 'E', 'D', 'G', 'E', 'S' };
+	static const U32 VERSION = 1;
+	static const U32 EDGES_PER_BLOCK = 4096;
+
+	struct Header
+	{
+		char magic[8];
+		U32 version;
+		U32 lines;
+		U64 sampleRate;
+		U64 lastSample;			// the capture ends with this sample
+		U32 edgesPerBlock;
+		U32 reserved;
+	};
+
+	struct LineHeader
+	{
+		U8 present;
+		U8 initial;				// BitState at sample 0
+		U8 reserved[6];
+		U64 edges;
+		U64 dataOffset;			// from the beginning of the file
+		U64 dataSize;
+		U64 indexOffset;
+	};
+
+	struct BlockIndex
+	{
+		U64 edgeBefore;			// sample of the last edge of the block before, 0 for the first block
+		U64 dataOffset;			// from the beginning of the line data
+	};
+}
+
+// Collects the edges line by line and writes the capture at the end. The deltas of every line wait in
+// a temporary file of their own, only the block index is kept in memory.
+class EdgeCaptureWriter
+{
+public:
+	typedef std::shared_ptr<EdgeCaptureWriter> ptr;
+	static EdgeCaptureWriter::ptr factory(U64 sampleRate);
+	virtual ~EdgeCaptureWriter();
+
+	void SetInitialState(EdgeCapture::Line line, BitState state);
+	// edges of a line come in ascending order
+	void AddEdge(EdgeCapture::Line line, U64 sample);
+	bool Write(const std::string& path, U64 lastSample);
+
+protected:
+	EdgeCaptureWriter(U64 sampleRate);
+
+	// deltas are moved to the temporary file in pieces of this size
+	static const std::size_t SPILL_BYTES = 1 << 20;
+
+	struct LineData
+	{
+		bool present;
+		BitState initial;
+		U64 edges;
+		U64 lastEdge;
+		U64 size;			// bytes of deltas, including the ones in the temporary file
+		std::vector<U8> data;
+		FILE* spill;		// null until the first piece is moved
+		std::vector<EdgeCapture::BlockIndex> index;
+	};
+
+	bool Spill(LineData& line);
+
+	U64 _sampleRate;
+	LineData _lines[EdgeCapture::LINES];
+	bool _failed = false;
+};
+
+// Capture mapped into memory, lines are read through channel sources sharing the mapping
+class EdgeCaptureFile : public std::enable_shared_from_this<EdgeCaptureFile>
+{
+public:
+	typedef std::shared_ptr<EdgeCaptureFile> ptr;
+	// null when the file cannot be mapped or is not a capture
+	static EdgeCaptureFile::ptr factory(const std::string& path);
+	virtual ~EdgeCaptureFile();
+
+	U64 GetSampleRate() const
+	{
+		return _header.sampleRate;
+	}
+	U64 GetLastSample() const
+	{
+		return _header.lastSample;
+	}
+	bool HasLine(EdgeCapture::Line line) const
+	{
+		return _lines[line].present != 0;
+	}
+	U64 GetEdgeCount(EdgeCapture::Line line) const
+	{
+		return _lines[line].edges;
+	}
+	// a new cursor at sample 0 on every call, null for a line not recorded
+	ChannelSource::ptr OpenLine(EdgeCapture::Line line);
+
+protected:
+	EdgeCaptureFile();
+
+	bool Map(const std::string& path);
+	bool Validate();
+
+	const U8* _data = nullptr;
+	U64 _size = 0;
+	EdgeCapture::Header _header;
+	EdgeCapture::LineHeader _lines[EdgeCapture::LINES];
+
+#ifdef _WIN32
+	void* _file = nullptr;
+	void* _mapping = nullptr;
+#else
+	int _file = -1;
+#endif //_WIN32
+};
+
+// Cursor over the deltas of one line, decodes them as it goes and jumps over whole blocks
+class EdgeCaptureChannel : public ChannelSource
+{
+public:
+	virtual U64 GetSampleNumber();
+	virtual BitState GetBitState();
+	virtual U32 AdvanceToAbsPosition(U64 sample);
+	virtual void AdvanceToNextEdge();
+	virtual U64 GetSampleOfNextEdge();
+	virtual bool WouldAdvancingToAbsPositionCauseTransition(U64 sample);
+	virtual bool DoMoreTransitionsExistInCurrentData();
+
+protected:
+	friend class EdgeCaptureFile;
+	EdgeCaptureChannel(EdgeCaptureFile::ptr file, const EdgeCapture::LineHeader& line, U64 lastSample, U32 edgesPerBlock, const U8* data);
+
+	void ReadNextEdge();
+	void JumpToBlock(U64 block);
+
+	EdgeCaptureFile::ptr _file;		// keeps the mapping
+	const U8* _begin;
+	const U8* _end;
+	const EdgeCapture::BlockIndex* _index;
+	U64 _blocks;
+	U32 _edgesPerBlock;
+	BitState _initial;
+	U64 _edges;
+	U64 _lastSample;
+
+	U64 _sample = 0;
+	U64 _next = 0;					// edges before it are behind the cursor
+	U64 _nextEdge = 0;				// sample of edge _next
+	const U8* _read;				// deltas after edge _next
+};
+
+#endif //EDGE_CAPTURE_H
@@ -64,4 +64,12 @@ public:
 	}
 };
 
+class EndOfDataException : public DecoderException
+{
+public:
+	EndOfDataException(unsigned long long int pos) : DecoderException(pos, "End of data")
+	{
+	}
+};
+
 #endif //EXCEPTIONS_HPP
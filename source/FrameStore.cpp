@@ -0,0 +1,168 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include "FrameStore.h"
+#include <algorithm>
+#include <AnalyzerHelpers.h>
+#include "Convert.hpp"
+#include "ProtocolFrames.h"
+
+FrameStore::ptr FrameStore::factory()
+{
+	FrameStore::ptr ret(new FrameStore());
+	return ret;
+}
+
+FrameStore::FrameStore()
+{
+	_pool.push_back('\0');
+}
+
+FrameStore::~FrameStore()
+{
+}
+
+U64 FrameStore::AddString(const std::string& str)
+{
+	if (str.empty())
+	{
+		return 0;
+	}
+	U64 offset = _pool.size();
+	_pool.insert(_pool.end(), str.begin(), str.end());
+	_pool.push_back('\0');
+	return offset;
+}
+
+std::size_t FrameStore::AddText(U32 channelIndex, const std::string& strShort, const std::string& strMedium, const std::string& strDetailed)
+{
+	Record record;
+	record.channelIndex = channelIndex;
+	record.kind = TEXT;
+	record.value = 0;
+	record.length = 0;
+	if (strMedium.empty() && strDetailed.empty())
+	{
+		record.text = AddString(strShort);
+	}
+	else
+	{
+		// the three strings go one after another, empty ones included
+		record.value = 1;
+		record.text = _pool.size();
+		_pool.insert(_pool.end(), strShort.begin(), strShort.end());
+		_pool.push_back('\0');
+		_pool.insert(_pool.end(), strMedium.begin(), strMedium.end());
+		_pool.push_back('\0');
+		_pool.insert(_pool.end(), strDetailed.begin(), strDetailed.end());
+		_pool.push_back('\0');
+	}
+	_records.push_back(record);
+	return _records.size() - 1;
+}
+
+std::size_t FrameStore::AddByte(U32 channelIndex, unsigned char value, const std::string& name)
+{
+	Record record;
+	record.text = AddString(name);
+	record.channelIndex = channelIndex;
+	record.kind = BYTE;
+	record.value = value;
+	record.length = 0;
+	_records.push_back(record);
+	return _records.size() - 1;
+}
+
+std::size_t FrameStore::AddBlock(U32 channelIndex, int block, const unsigned char* bytes, std::size_t count)
+{
+	Record record;
+	record.text = _pool.size();
+	record.channelIndex = channelIndex;
+	record.kind = BLOCK;
+	record.value = static_cast<U8>(block);
+	record.length = static_cast<U16>(std::min<std::size_t>(count, 0xFFFF));
+	_pool.insert(_pool.end(), bytes, bytes + record.length);
+	_records.push_back(record);
+	return _records.size() - 1;
+}
+
+std::size_t FrameStore::GetMemoryUsage() const
+{
+	return _records.capacity() * sizeof(Record) + _pool.capacity();
+}
+
+void FrameStore::RenderBubbleText(std::size_t index, U32 channelIndex, DisplayBase display_base, std::vector<std::string>& strings) const
+{
+	strings.clear();
+	const Record& record = _records[index];
+	if (channelIndex != record.channelIndex) return;
+
+	if (record.kind == BLOCK)
+	{
+		BlockFrame::Block block = static_cast<BlockFrame::Block>(record.value);
+		if (*BlockFrame::GetShortName(block) != '\0')
+		{
+			strings.push_back(BlockFrame::GetShortName(block));
+			strings.push_back(BlockFrame::GetName(block));
+		}
+		strings.push_back(BlockFrame::Render(block, GetBytes(record), record.length));
+		return;
+	}
+
+	const char* str = GetString(record.text);
+	if (record.kind == BYTE)
+	{
+		char number_str[128];
+		AnalyzerHelpers::GetNumberString(record.value, display_base, 8, number_str, sizeof(number_str));
+		strings.push_back(number_str);
+		if (*str != '\0')
+		{
+			strings.push_back(std::string(str) + std::string(" ") + std::string(number_str));
+		}
+		return;
+	}
+
+	strings.push_back(str);
+	if (record.value == 0) return;
+
+	const char* medium = GetNextString(str);
+	if (*medium != '\0')
+	{
+		strings.push_back(medium);
+	}
+	const char* detailed = GetNextString(medium);
+	if (*detailed != '\0')
+	{
+		strings.push_back(detailed);
+	}
+}
+
+std::string FrameStore::ToString(std::size_t index) const
+{
+	const Record& record = _records[index];
+	if (record.kind == BLOCK)
+	{
+		return BlockFrame::Render(static_cast<BlockFrame::Block>(record.value), GetBytes(record), record.length);
+	}
+
+	const char* str = GetString(record.text);
+	if (record.kind == BYTE)
+	{
+		if (*str == '\0') return Convert::ToHex(record.value);
+		return std::string(str) + std::string(" ") + Convert::ToHex(record.value);
+	}
+
+	if (record.value == 0) return str;
+	const char* medium = GetNextString(str);
+	const char* detailed = GetNextString(medium);
+	if (*detailed != '\0') return detailed;
+	if (*medium != '\0') return medium;
+	return str;
+}
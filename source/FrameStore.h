@@ -0,0 +1,88 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef FRAME_STORE_H
+#define FRAME_STORE_H
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <AnalyzerResults.h>
+
+// Decoded frames kept for rendering: a fixed-size record per frame in one array and the texts
+// in one pool of NUL-terminated strings the records point into. Nothing is allocated per frame.
+// ATR, PPS and T=1 blocks keep their bytes in the pool, their text is rendered when Logic asks for it.
+//
+// Not synchronised, the owner guards it when frames are added and rendered from different threads.
+class FrameStore
+{
+public:
+	typedef std::shared_ptr<FrameStore> ptr;
+
+	enum Kind
+	{
+		TEXT,		// short, medium and detailed text, the last two may be empty
+		BYTE,		// a byte and an optional name
+		BLOCK,		// bytes of a BlockFrame::Block
+	};
+
+	struct Record
+	{
+		U64 text;			// offset of the first string or of the bytes in the pool
+		U32 channelIndex;
+		U8 kind;
+		U8 value;			// the byte, the block type, for texts 1 when the medium and detailed ones follow the short one
+		U16 length;			// bytes of a block
+	};
+
+	static FrameStore::ptr factory();
+	virtual ~FrameStore();
+
+	// the index of the frame is returned
+	std::size_t AddText(U32 channelIndex, const std::string& strShort, const std::string& strMedium, const std::string& strDetailed);
+	std::size_t AddByte(U32 channelIndex, unsigned char value, const std::string& name);
+	std::size_t AddBlock(U32 channelIndex, int block, const unsigned char* bytes, std::size_t count);
+
+	std::size_t GetCount() const
+	{
+		return _records.size();
+	}
+	// bytes held by the records and the pool
+	std::size_t GetMemoryUsage() const;
+
+	// no strings when the frame is on another channel
+	void RenderBubbleText(std::size_t index, U32 channelIndex, DisplayBase display_base, std::vector<std::string>& strings) const;
+	// the most detailed text
+	std::string ToString(std::size_t index) const;
+
+protected:
+	FrameStore();
+
+	U64 AddString(const std::string& str);
+	const char* GetString(U64 offset) const
+	{
+		return &_pool[static_cast<std::size_t>(offset)];
+	}
+	const unsigned char* GetBytes(const Record& record) const
+	{
+		return reinterpret_cast<const unsigned char*>(&_pool[static_cast<std::size_t>(record.text)]);
+	}
+	const char* GetNextString(const char* str) const
+	{
+		return str + std::strlen(str) + 1;
+	}
+
+	std::vector<Record> _records;
+	std::vector<char> _pool;		// starts with the empty string every empty text points to
+};
+
+#endif //FRAME_STORE_H
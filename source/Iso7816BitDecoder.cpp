@@ -9,17 +9,20 @@
 //
 
 #include "Iso7816BitDecoder.h"
-#include "SaleaeHelper.hpp"
-#include "Exceptions.hpp"
 #include "Logging.hpp"
+#include "Convert.hpp"
+#include "Definitions.hpp"
+#include "TraceBuffer.h"
+#include <algorithm>
+#include <vector>
 
-Iso7816BitDecoder::ptr Iso7816BitDecoder::factory(AnalyzerChannelData* io, AnalyzerChannelData* reset, AnalyzerChannelData* vcc, AnalyzerChannelData* clk)
+Iso7816BitDecoder::ptr Iso7816BitDecoder::factory(ChannelSource::ptr io, ChannelSource::ptr reset, ChannelSource::ptr vcc, ChannelSource::ptr clk)
 {
 	Iso7816BitDecoder::ptr ret(new Iso7816BitDecoder(io, reset, vcc, clk));
 	return ret;
 }
 
-Iso7816BitDecoder::Iso7816BitDecoder(AnalyzerChannelData* io, AnalyzerChannelData* reset, AnalyzerChannelData* vcc, AnalyzerChannelData* clk)
+Iso7816BitDecoder::Iso7816BitDecoder(ChannelSource::ptr io, ChannelSource::ptr reset, ChannelSource::ptr vcc, ChannelSource::ptr clk)
 {
 	_io = io;
 	_reset = reset;
@@ -33,83 +36,481 @@ Iso7816BitDecoder::~Iso7816BitDecoder()
 
 void Iso7816BitDecoder::Sync(u64 pos)
 {
-	SaleaeHelper::AdvanceToAbsPositionOrThrow(_io, pos, std::string("I/O"));
-	SaleaeHelper::AdvanceToAbsPositionOrThrow(_reset, pos, std::string("RESET"));
-	SaleaeHelper::AdvanceToAbsPositionOrThrow(_vcc, pos, std::string("Vcc"));
-	SaleaeHelper::AdvanceToAbsPositionOrThrow(_clk, pos, std::string("CLK"));
+	// channels are moved to the cursor only when they are read, RST is checked against a bound
+	// and Vcc is not read at all
+	if (pos < _cursor)
+	{
+		throw std::runtime_error(std::string("Cannot sync back to position: ") + Convert::ToDec(pos) + std::string(", cursor is at: ") + Convert::ToDec(_cursor));
+	}
+	_cursor = pos;
 }
 
 Iso7816BitDecoder::u64 Iso7816BitDecoder::SeekForResetEdge(bool& high)
 {
-	Logging::Write(std::string("Looking for RST going high..."));
+	LOG_DEBUG("Looking for RST going high...");
 	_reset->AdvanceToNextEdge();
+	ForgetResetEdge();
 
 	high = _reset->GetBitState() == BIT_HIGH;
 	return _reset->GetSampleNumber();
 }
 
-Iso7816BitDecoder::u64 Iso7816BitDecoder::SeekForIoFallingEdge()
+void Iso7816BitDecoder::StartAt(u64 pos)
+{
+	// a decoder of its own segment starts right there, RST edges before do not count
+	_reset->AdvanceToAbsPosition(pos);
+	ForgetResetEdge();
+	Restart(pos);
+}
+
+void Iso7816BitDecoder::Restart(u64 pos)
 {
+	// nothing learned about the clock is kept, a session is decoded the same after others as on its own
+	_clkIndex.Clear();
+	_clkAheadEdges = 0;
+	_useClk = true;
+	_samplesPerClk = 0.0;
+	_sampleFraction = 0.0;
+	Sync(pos);
+}
+
+DecodeStatus Iso7816BitDecoder::SeekForIoFallingEdge()
+{
+	SyncIo();
 	// ensure line is HIGH
 	while (_io->GetBitState() != BIT_HIGH)
 	{
-		AdvanceToNextEdgeWithResetDetection(_io);
+		DecodeStatus status = AdvanceToNextEdgeWithResetDetection(_io.get());
+		if (status.Failed()) return status;
 	}
 	// if so the next edge is falling down
-	AdvanceToNextEdgeWithResetDetection(_io);
-	return _io->GetSampleNumber();
+	return AdvanceToNextEdgeWithResetDetection(_io.get());
 }
 
-Iso7816BitDecoder::u64 Iso7816BitDecoder::AdvanceClkCycles(std::size_t cycles)
+DecodeStatus Iso7816BitDecoder::SeekForStartBit(u64 previousStart, std::size_t guardCycles)
 {
-	for (std::size_t i = 0; i < cycles; i++)
+	double samplesPerClk = GetCurrentSamplesPerClk();
+	SyncIo();
+	if (samplesPerClk <= 0.0 || _io->GetBitState() != BIT_HIGH)
 	{
-		AdvanceToNextEdgeWithResetDetection(_clk);
-		AdvanceToNextEdgeWithResetDetection(_clk);
+		return SeekForIoFallingEdge();
 	}
-	return _clk->GetSampleNumber();
+
+	// no character can start before the guard time is over, I/O stays HIGH until then;
+	// a little less is waited for, the clock period is an estimate
+	u64 earliest = previousStart + static_cast<u64>((guardCycles - guardCycles / 64) * samplesPerClk);
+	if (earliest > _io->GetSampleNumber())
+	{
+		if (_io->WouldAdvancingToAbsPositionCauseTransition(earliest))
+		{
+			return DecodeStatus::Failure(DecodeStatus::GUARD_TIME, _io->GetSampleOfNextEdge());
+		}
+		DecodeStatus status = CheckResetBefore(earliest);
+		if (status.Failed()) return status;
+		_io->AdvanceToAbsPosition(earliest);
+	}
+	return AdvanceToNextEdgeWithResetDetection(_io.get());
 }
 
-Iso7816BitDecoder::u64 Iso7816BitDecoder::AdvanceToNextIoEdge()
+DecodeStatus Iso7816BitDecoder::AdvanceClkCycles(std::size_t cycles)
 {
-	AdvanceToNextEdgeWithResetDetection(_io);
-	return _io->GetSampleNumber();
+	if (!HasClk())
+	{
+		return AdvanceSamplesForClkCycles(cycles);
+	}
+
+	SyncClk();
+	u64 edges = static_cast<u64>(cycles) * 2;
+	u64 ahead = GetClkEdgesAhead();
+	if (ahead > 0)
+	{
+		// an earlier jump went past some of these edges already
+		if (edges <= ahead)
+		{
+			_clkAheadEdges -= edges;
+			_clkAheadPosition += static_cast<u64>(edges * _clkAheadSpacing + 0.5);
+			return DecodeStatus::Ok(_clkAheadPosition);
+		}
+		edges -= ahead;
+		_clkAheadEdges = 0;
+	}
+	while (edges > 0)
+	{
+		// jump over the bulk of edges predicted by the clock index, leave a few ones to land exactly on the edge
+		u64 margin = std::max<u64>(2, edges / 8);
+		u64 span = (edges > margin) ? _clkIndex.EstimateSamples(edges - margin) : 0;
+		if (span == 0)
+		{
+			DecodeStatus status = StepClkEdge();
+			if (status.Failed()) return status;
+			edges--;
+			continue;
+		}
+
+		u64 from = _clk->GetSampleNumber();
+		u64 to = from + span;
+		DecodeStatus status = CheckResetBefore(to);
+		if (status.Failed()) return status;
+		u64 crossed = _clk->AdvanceToAbsPosition(to);
+		_clkIndex.Add(from, to, crossed);
+
+		if (crossed >= edges)
+		{
+			// the clock got faster than predicted and CLK cannot go back, so place the target edge by the period just
+			// crossed and keep the edges behind the cursor for the next advance
+			u64 overrun = crossed - edges;
+			LOG_DEBUG("CLK period changed, overrun by %llu edges", static_cast<unsigned long long>(overrun));
+			TRACE_EVENT(TraceBuffer::CLK_OVERRUN, to, static_cast<U32>(overrun));
+			double spacing = static_cast<double>(to - from) / crossed;
+			u64 target = from + static_cast<u64>(edges * spacing + 0.5);
+			if (_clk->DoMoreTransitionsExistInCurrentData())
+			{
+				// count back from the next edge, it is a real one
+				double back = (overrun + 1) * spacing;
+				double next = static_cast<double>(_clk->GetSampleOfNextEdge());
+				if (next - back > from) target = static_cast<u64>(next - back + 0.5);
+			}
+			target = std::min(target, to);
+			_clkAheadEdges = overrun;
+			_clkAheadPosition = target;
+			_clkAheadSpacing = spacing;
+			return DecodeStatus::Ok(target);
+		}
+		edges -= crossed;
+
+		if (crossed == 0)
+		{
+			// clock stopped, wait for it edge by edge
+			status = StepClkEdge();
+			if (status.Failed()) return status;
+			edges--;
+		}
+	}
+	return DecodeStatus::Ok(_clk->GetSampleNumber());
+}
+
+DecodeStatus Iso7816BitDecoder::AdvanceToNextIoEdge()
+{
+	SyncIo();
+	return AdvanceToNextEdgeWithResetDetection(_io.get());
 }
 
 BitState Iso7816BitDecoder::GetIoState()
 {
+	SyncIo();
 	return _io->GetBitState();
 }
 
 Iso7816BitDecoder::u64 Iso7816BitDecoder::GetIoPosition()
 {
+	SyncIo();
 	return _io->GetSampleNumber();
 }
 
-std::size_t Iso7816BitDecoder::CountClkCyclesToPosition(u64 pos)
+DecodeStatus Iso7816BitDecoder::CountClkCyclesToPosition(u64 pos, std::size_t& cycles)
 {
-	std::size_t ret = 0;
-	while (_clk->GetSampleOfNextEdge() < pos)
+	cycles = 0;
+	if (!HasClk())
 	{
-		AdvanceToNextEdgeWithResetDetection(_clk);
-		if (_clk->GetSampleOfNextEdge() > pos)
+		SyncIo();
+		u64 cur = _io->GetSampleNumber();
+		if (pos > cur && _samplesPerClk > 0.0)
 		{
-			// not possible to advance more
-			break;
+			cycles = static_cast<std::size_t>((pos - cur) / _samplesPerClk);
 		}
-		AdvanceToNextEdgeWithResetDetection(_clk);
-		ret++;
+		return DecodeStatus::Ok(pos);
 	}
-	return ret;
+
+	SyncClk();
+	u64 ahead = GetClkEdgesAhead();
+	_clkAheadEdges = 0;
+	u64 from = _clk->GetSampleNumber();
+	if (pos <= from)
+	{
+		if (ahead > 0 && pos > _clkAheadPosition) cycles = static_cast<std::size_t>(std::min<u64>(ahead, static_cast<u64>((pos - _clkAheadPosition) / _clkAheadSpacing)) / 2);
+		return DecodeStatus::Ok(pos);
+	}
+
+	DecodeStatus status = CheckResetBefore(pos);
+	if (status.Failed()) return status;
+	u64 crossed = _clk->AdvanceToAbsPosition(pos);
+	_clkIndex.Add(from, pos, crossed);
+	cycles = static_cast<std::size_t>((ahead + crossed) / 2);
+	return DecodeStatus::Ok(pos);
 }
 
 
-void Iso7816BitDecoder::AdvanceToNextEdgeWithResetDetection(AnalyzerChannelData* channel)
+DecodeStatus Iso7816BitDecoder::ProbeClk(std::size_t cycles, ClkProbe& probe)
 {
-	u64 pos = channel->GetSampleOfNextEdge();
-	if (_reset->WouldAdvancingToAbsPositionCauseTransition(pos))
+	ClkProbe ret = { 0.0, 0, false };
+	probe = ret;
+	if (_clk == nullptr || cycles < 2) return DecodeStatus::Ok(_cursor);
+
+	SyncClk();
+	_clkAheadEdges = 0;
+
+	// every other edge has the same polarity, those are one period apart
+	std::vector<u64> edges;
+	edges.reserve(cycles + 1);
+	DecodeStatus status = StepClkEdge();
+	if (status.Failed()) return status;
+	edges.push_back(_clk->GetSampleNumber());
+	for (std::size_t i = 0; i < cycles; i++)
+	{
+		status = StepClkEdge();
+		if (!status.Failed()) status = StepClkEdge();
+		if (status.Failed()) return status;
+		edges.push_back(_clk->GetSampleNumber());
+	}
+
+	std::vector<u64> periods;
+	periods.reserve(cycles);
+	for (std::size_t i = 1; i < edges.size(); i++)
+	{
+		periods.push_back(edges[i] - edges[i - 1]);
+	}
+	std::vector<u64> sorted(periods);
+	std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+	u64 median = sorted[sorted.size() / 2];
+
+	std::size_t regular = 0;
+	for (u64 period : periods)
+	{
+		// aliased or glitchy clock does not keep the period, sampling adds at most one sample
+		if (period + 1 >= median && period <= median + 1) regular++;
+	}
+
+	ret.samplesPerClk = static_cast<double>(edges.back() - edges.front()) / periods.size();
+	ret.regularity = static_cast<unsigned int>((regular * 100) / periods.size());
+	ret.usable = ret.samplesPerClk >= MIN_SAMPLES_PER_CLK && ret.regularity >= MIN_CLK_REGULARITY;
+
+	// a usable clock is as sure as its weaker measurement, twice the minimum samples per cycle and every
+	// period regular count as sure; a rejected one as its worse measurement, down to no samples or regularity
+	double samplesMargin = (ret.samplesPerClk - MIN_SAMPLES_PER_CLK) / MIN_SAMPLES_PER_CLK;
+	double regularityMargin = ret.regularity >= MIN_CLK_REGULARITY
+		? static_cast<double>(ret.regularity - MIN_CLK_REGULARITY) / (100 - MIN_CLK_REGULARITY)
+		: static_cast<double>(ret.regularity - MIN_CLK_REGULARITY) / MIN_CLK_REGULARITY;
+	double margin = ret.usable ? std::min(samplesMargin, regularityMargin) : -std::min(samplesMargin, regularityMargin);
+	ret.margin = static_cast<unsigned int>(std::min(margin, 1.0) * 100.0 + 0.5);
+	probe = ret;
+	return DecodeStatus::Ok(_clk->GetSampleNumber());
+}
+
+DecodeStatus Iso7816BitDecoder::ReadCharacter(std::size_t etu, Character& ch)
+{
+	// I/O is at the end of the start bit, bit centres are known in advance once the clock period is known
+	double samplesPerClk = GetCurrentSamplesPerClk();
+	if (samplesPerClk <= 0.0)
+	{
+		// clock period not known yet, sample bit by bit
+		return SampleCharacter(etu, ch);
+	}
+
+	SyncIo();
+	u64 start = _io->GetSampleNumber();
+	for (int i = 0; i < CHARACTER_BITS; i++)
+	{
+		ch.bitCentres[i] = start + static_cast<u64>((etu / 2 + i * etu) * samplesPerClk);
+	}
+	u64 end = ch.bitCentres[CHARACTER_BITS - 1];
+	DecodeStatus status = CheckResetBefore(end);
+	if (status.Failed()) return status;
+
+	// only I/O transitions within the character are visited
+	const u64 none = ~0ULL;
+	u64 nextEdge = _io->WouldAdvancingToAbsPositionCauseTransition(end) ? _io->GetSampleOfNextEdge() : none;
+	BitState state = _io->GetBitState();
+	ch.line = 0;
+	for (int i = 0; i < CHARACTER_BITS; i++)
+	{
+		while (nextEdge <= ch.bitCentres[i])
+		{
+			_io->AdvanceToNextEdge();
+			state = _io->GetBitState();
+			nextEdge = _io->WouldAdvancingToAbsPositionCauseTransition(end) ? _io->GetSampleOfNextEdge() : none;
+		}
+		if (i < CHARACTER_BITS - 1)
+		{
+			ch.line = (ch.line << 1) | (state == BIT_HIGH ? 1 : 0);
+		}
+		else
+		{
+			ch.guardHigh = state == BIT_HIGH;
+		}
+	}
+	_io->AdvanceToAbsPosition(end);
+	return DecodeStatus::Ok(end);
+}
+
+double Iso7816BitDecoder::GetCurrentSamplesPerClk()
+{
+	return HasClk() ? 2.0 * _clkIndex.GetSamplesPerEdge() : _samplesPerClk;
+}
+
+DecodeStatus Iso7816BitDecoder::SampleCharacter(std::size_t etu, Character& ch)
+{
+	// advance to the middle of first bit, then bit by bit
+	DecodeStatus status = AdvanceClkCycles(etu / 2);
+	if (status.Failed()) return status;
+	Sync(status.position);
+	ch.line = 0;
+	for (int i = 0; i < CHARACTER_BITS; i++)
+	{
+		ch.bitCentres[i] = status.position;
+		if (i < CHARACTER_BITS - 1)
+		{
+			ch.line = (ch.line << 1) | (GetIoState() == BIT_HIGH ? 1 : 0);
+			status = AdvanceClkCycles(etu);
+			if (status.Failed()) return status;
+			Sync(status.position);
+		}
+		else
+		{
+			ch.guardHigh = GetIoState() == BIT_HIGH;
+		}
+	}
+	return status;
+}
+
+std::size_t Iso7816BitDecoder::CalibrateFromStartBit(u64 fallingEdge, u64 risingEdge)
+{
+	double width = static_cast<double>(risingEdge - fallingEdge);
+	if (_samplesPerClk > 0.0)
+	{
+		// CLK frequency is known, check if this is really a start bit
+		std::size_t etu = static_cast<std::size_t>(width / _samplesPerClk + 0.5);
+		if (etu <= DEF_ETU_MIN || etu >= DEF_ETU_MAX)
+		{
+			return etu;
+		}
+	}
+	// the start bit of TS lasts the default ETU, it gives the real card clock
+	_samplesPerClk = width / DEF_ETU;
+	_sampleFraction = 0.0;
+	LOG_INFO("Samples per CLK cycle measured from TS: %.3f", _samplesPerClk);
+	TRACE_EVENT(TraceBuffer::CLK_FROM_TS, risingEdge, static_cast<U32>(_samplesPerClk * 1000.0 + 0.5));
+	return DEF_ETU;
+}
+
+
+std::string Iso7816BitDecoder::DescribeLines()
+{
+	return
+		std::string("I/O: ") + Convert::ToDec(_io->GetSampleNumber()) + std::string("(") + (_io->GetBitState() == BIT_HIGH ? "1" : "0") + std::string("), ") +
+		std::string("RST: ") + Convert::ToDec(_reset->GetSampleNumber()) + std::string("(") + (_reset->GetBitState() == BIT_HIGH ? "1" : "0") + std::string("), ") +
+		(_clk ? std::string("CLK: ") + Convert::ToDec(_clk->GetSampleNumber()) + std::string("(") + (_clk->GetBitState() == BIT_HIGH ? "1" : "0") + std::string("), ") : std::string("CLK: n/a, ")) +
+		std::string("Vcc: ") + Convert::ToDec(_vcc->GetSampleNumber()) + std::string("(") + (_vcc->GetBitState() == BIT_HIGH ? "1" : "0") + std::string(")");
+}
+
+void Iso7816BitDecoder::SyncIo()
+{
+	if (_io->GetSampleNumber() < _cursor)
 	{
-		throw ResetException(_reset->GetSampleOfNextEdge());
+		_io->AdvanceToAbsPosition(_cursor);
 	}
+}
+
+void Iso7816BitDecoder::SyncClk()
+{
+	// keep the clock index contiguous, edges skipped here still tell about the clock period
+	u64 from = _clk->GetSampleNumber();
+	if (from < _cursor)
+	{
+		_clkIndex.Add(from, _cursor, _clk->AdvanceToAbsPosition(_cursor));
+	}
+}
+
+DecodeStatus Iso7816BitDecoder::AdvanceToNextEdgeWithResetDetection(ChannelSource* channel)
+{
+	DecodeStatus status = CheckResetBefore(channel->GetSampleOfNextEdge());
+	if (status.Failed()) return status;
 	channel->AdvanceToNextEdge();
-}
\ No newline at end of file
+	return DecodeStatus::Ok(channel->GetSampleNumber());
+}
+
+DecodeStatus Iso7816BitDecoder::CheckResetBefore(u64 pos)
+{
+	if (pos < _resetBound)
+	{
+		return DecodeStatus::Ok(pos);
+	}
+	if (_resetEdgeKnown)
+	{
+		return DecodeStatus::Failure(DecodeStatus::RESET, _resetBound);
+	}
+
+	// once the next RST edge is in the data it bounds every advance until RST moves
+	if (!_resetQuiet && _reset->DoMoreTransitionsExistInCurrentData())
+	{
+		_resetBound = _reset->GetSampleOfNextEdge();
+		_resetEdgeKnown = true;
+		return CheckResetBefore(pos);
+	}
+
+	// no RST edge captured so far, asking for the next one would wait for more data
+	_resetQuiet = true;
+	if (_reset->WouldAdvancingToAbsPositionCauseTransition(pos))
+	{
+		_resetBound = _reset->GetSampleOfNextEdge();
+		_resetEdgeKnown = true;
+		return DecodeStatus::Failure(DecodeStatus::RESET, _resetBound);
+	}
+	_resetBound = pos + 1;
+	return DecodeStatus::Ok(pos);
+}
+
+Iso7816BitDecoder::u64 Iso7816BitDecoder::GetClkEdgesAhead()
+{
+	if (_clkAheadEdges == 0) return 0;
+	if (_cursor >= _clk->GetSampleNumber())
+	{
+		_clkAheadEdges = 0;
+		return 0;
+	}
+	if (_cursor > _clkAheadPosition)
+	{
+		// the decoder moved on by itself, drop the edges it has passed
+		u64 passed = static_cast<u64>((_cursor - _clkAheadPosition) / _clkAheadSpacing);
+		_clkAheadEdges -= std::min(passed, _clkAheadEdges);
+		_clkAheadPosition = _cursor;
+	}
+	return _clkAheadEdges;
+}
+
+void Iso7816BitDecoder::ForgetResetEdge()
+{
+	_resetBound = 0;
+	_resetEdgeKnown = false;
+	_resetQuiet = false;
+}
+
+DecodeStatus Iso7816BitDecoder::StepClkEdge()
+{
+	u64 from = _clk->GetSampleNumber();
+	DecodeStatus status = AdvanceToNextEdgeWithResetDetection(_clk.get());
+	if (status.Failed()) return status;
+	_clkIndex.AddEdge(from, status.position);
+	return status;
+}
+
+DecodeStatus Iso7816BitDecoder::AdvanceSamplesForClkCycles(std::size_t cycles)
+{
+	SyncIo();
+	u64 from = _io->GetSampleNumber();
+	if (_samplesPerClk <= 0.0)
+	{
+		// nothing known about the clock yet
+		return DecodeStatus::Ok(from);
+	}
+
+	// carry the fraction of a sample, so rounding does not accumulate over a frame
+	double span = cycles * _samplesPerClk + _sampleFraction;
+	u64 samples = static_cast<u64>(span);
+	_sampleFraction = span - samples;
+
+	u64 to = from + samples;
+	DecodeStatus status = CheckResetBefore(to);
+	if (status.Failed()) return status;
+	_io->AdvanceToAbsPosition(to);
+	return status;
+}
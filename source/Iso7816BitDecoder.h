@@ -12,7 +12,10 @@
 #define ISO7816_BIT_DECODER
 
 #include <memory>
-#include <AnalyzerChannelData.h>
+#include <string>
+#include "ChannelSource.h"
+#include "ClockIndex.h"
+#include "DecodeStatus.h"
 
 class Iso7816BitDecoder
 {
@@ -20,28 +23,114 @@ public:
 	typedef std::shared_ptr<Iso7816BitDecoder> ptr;
 	typedef unsigned long long int u64;
 
+	struct ClkProbe
+	{
+		double samplesPerClk;		// average CLK period in samples
+		unsigned int regularity;	// % of periods within +/- 1 sample of the median
+		bool usable;
+		unsigned int margin;		// % of the way from the limits to a sure decision, whichever way it went
+	};
+
+	// start bit excluded, 8 data bits, parity and the guard time
+	static const int CHARACTER_BITS = 10;
+
+	struct Character
+	{
+		u64 bitCentres[CHARACTER_BITS];	// sampling positions
+		unsigned short line;			// data bits followed by parity as seen on I/O, first received is MSB
+		bool guardHigh;					// I/O state in the guard time, LOW is an error signal
+	};
+
 public:
-	static Iso7816BitDecoder::ptr factory(AnalyzerChannelData* io, AnalyzerChannelData* reset, AnalyzerChannelData* vcc, AnalyzerChannelData* clk);
+	static Iso7816BitDecoder::ptr factory(ChannelSource::ptr io, ChannelSource::ptr reset, ChannelSource::ptr vcc, ChannelSource::ptr clk);
 	virtual ~Iso7816BitDecoder();
 
 	void Sync(u64 pos);
+	u64 GetCursor()
+	{
+		return _cursor;
+	}
 	u64 SeekForResetEdge(bool& high);
-	u64 SeekForIoFallingEdge();
-	u64 AdvanceClkCycles(std::size_t cycles);
-	u64 AdvanceToNextIoEdge();
+	bool IsResetHigh()
+	{
+		return _reset->GetBitState() == BIT_HIGH;
+	}
+	void StartAt(u64 pos);
+	// a new session begins, the clock is learned again
+	void Restart(u64 pos);
+	DecodeStatus SeekForIoFallingEdge();
+	DecodeStatus SeekForStartBit(u64 previousStart, std::size_t guardCycles);
+	DecodeStatus AdvanceClkCycles(std::size_t cycles);
+	DecodeStatus AdvanceToNextIoEdge();
 	BitState GetIoState();
 	u64 GetIoPosition();
-	std::size_t CountClkCyclesToPosition(u64 pos);
+	DecodeStatus CountClkCyclesToPosition(u64 pos, std::size_t& cycles);
+
+	DecodeStatus ProbeClk(std::size_t cycles, ClkProbe& probe);
+	DecodeStatus ReadCharacter(std::size_t etu, Character& ch);
+
+	bool HasClkChannel()
+	{
+		return _clk != nullptr;
+	}
+	// without CLK channel clock cycles are converted into samples
+	bool HasClk()
+	{
+		return _clk != nullptr && _useClk;
+	}
+	void UseClk(bool useClk)
+	{
+		_useClk = useClk;
+	}
+	void SetSamplesPerClk(double samplesPerClk)
+	{
+		_samplesPerClk = samplesPerClk;
+	}
+	double GetSamplesPerClk()
+	{
+		return _samplesPerClk;
+	}
+	// 0 while the clock period is not known yet
+	double GetCurrentSamplesPerClk();
+	std::size_t CalibrateFromStartBit(u64 fallingEdge, u64 risingEdge);
+	std::string DescribeLines();
+	const ClockIndex& GetClockIndex() const
+	{
+		return _clkIndex;
+	}
 
 protected:
-	Iso7816BitDecoder(AnalyzerChannelData* io, AnalyzerChannelData* reset, AnalyzerChannelData* vcc, AnalyzerChannelData* clk);
+	Iso7816BitDecoder(ChannelSource::ptr io, ChannelSource::ptr reset, ChannelSource::ptr vcc, ChannelSource::ptr clk);
+
+	void SyncIo();
+	void SyncClk();
+	DecodeStatus AdvanceToNextEdgeWithResetDetection(ChannelSource* channel);
+	DecodeStatus CheckResetBefore(u64 pos);
+	void ForgetResetEdge();
+	u64 GetClkEdgesAhead();
+	DecodeStatus StepClkEdge();
+	DecodeStatus AdvanceSamplesForClkCycles(std::size_t cycles);
+	DecodeStatus SampleCharacter(std::size_t etu, Character& ch);
+
+	ChannelSource::ptr _io;
+	ChannelSource::ptr _reset;
+	ChannelSource::ptr _vcc;
+	ChannelSource::ptr _clk;		// null when not recorded
+	u64 _cursor = 0;
 
-	void AdvanceToNextEdgeWithResetDetection(AnalyzerChannelData* channel);
+	// RST has no edge before _resetBound; with _resetEdgeKnown there is one right on it
+	u64 _resetBound = 0;
+	bool _resetEdgeKnown = false;
+	bool _resetQuiet = false;
 
-	AnalyzerChannelData* _io;
-	AnalyzerChannelData* _reset;
-	AnalyzerChannelData* _vcc;
-	AnalyzerChannelData* _clk;
+	ClockIndex _clkIndex;
+	// CLK edges already crossed past the position handed out, after the clock outran the index
+	u64 _clkAheadEdges = 0;
+	u64 _clkAheadPosition = 0;
+	double _clkAheadSpacing = 0.0;
+	bool _useClk = true;
+	double _samplesPerClk = 0.0;
+	double _sampleFraction = 0.0;
 };
 
 #endif //ISO7816_BIT_DECODER
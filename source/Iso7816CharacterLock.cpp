@@ -0,0 +1,199 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "Iso7816CharacterLock.h"
+#include "CharacterTable.hpp"
+
+// start bit, 8 data bits, parity and the guard time
+static const int FRAMED_BITS = 11;
+// edges inside a character are accepted this far off a bit boundary, in ETU
+static const double BIT_BOUNDARY_TOLERANCE = 0.25;
+// I/O is HIGH at least this long before a start bit, in ETU
+static const double IDLE_BEFORE_START = 0.75;
+// runs used to estimate the ETU
+static const std::size_t MIN_RUNS = 16;
+
+Iso7816CharacterLock::ptr Iso7816CharacterLock::factory(bool initialHigh)
+{
+	Iso7816CharacterLock::ptr ret(new Iso7816CharacterLock(initialHigh));
+	return ret;
+}
+
+Iso7816CharacterLock::Iso7816CharacterLock(bool initialHigh)
+{
+	_initialHigh = initialHigh;
+}
+
+Iso7816CharacterLock::~Iso7816CharacterLock()
+{
+}
+
+void Iso7816CharacterLock::AddEdge(u64 pos)
+{
+	_edges.push_back(pos);
+}
+
+void Iso7816CharacterLock::Drop(std::size_t edges)
+{
+	edges = std::min(edges, _edges.size());
+	if (edges & 1)
+	{
+		_initialHigh = !_initialHigh;
+	}
+	_edges.erase(_edges.begin(), _edges.begin() + edges);
+	_candidate = 0;
+}
+
+bool Iso7816CharacterLock::EstimateEtu(double& samplesPerEtu) const
+{
+	if (_edges.size() < MIN_RUNS + 1)
+	{
+		return false;
+	}
+
+	u64 shortest = ~0ULL;
+	for (std::size_t i = 1; i < _edges.size(); i++)
+	{
+		shortest = std::min(shortest, _edges[i] - _edges[i - 1]);
+	}
+	if (shortest == 0)
+	{
+		return false;
+	}
+
+	// runs within a character are whole numbers of bits, idle times are left out
+	double samples = 0.0;
+	double bits = 0.0;
+	for (std::size_t i = 1; i < _edges.size(); i++)
+	{
+		double run = static_cast<double>(_edges[i] - _edges[i - 1]) / shortest;
+		double whole = std::floor(run + 0.5);
+		if (whole > 9.0 || std::fabs(run - whole) > BIT_BOUNDARY_TOLERANCE)
+		{
+			continue;
+		}
+		samples += static_cast<double>(_edges[i] - _edges[i - 1]);
+		bits += whole;
+	}
+	if (bits < MIN_RUNS)
+	{
+		return false;
+	}
+	samplesPerEtu = samples / bits;
+	return true;
+}
+
+bool Iso7816CharacterLock::Find(double samplesPerEtu, std::size_t count, u64 end, Lock& lock)
+{
+	if (samplesPerEtu != _candidateEtu)
+	{
+		_candidateEtu = samplesPerEtu;
+		_candidate = 0;
+	}
+
+	for (; _candidate < _edges.size(); _candidate++)
+	{
+		if (IsHighAfter(_candidate))
+		{
+			continue;
+		}
+
+		lock.characters.clear();
+		lock.row = GROWING;
+		lock.resume = 0;
+		std::size_t edge = _candidate;
+		for (; ; )
+		{
+			Character ch;
+			bool inverse = false;
+			std::size_t next = 0;
+			Framing framing = ReadCharacter(edge, samplesPerEtu, end, ch, inverse, next);
+			if (framing == VALID && !lock.characters.empty() && inverse != lock.inverse)
+			{
+				framing = INVALID;
+			}
+			if (framing == INVALID)
+			{
+				lock.row = BROKEN;
+				lock.resume = edge;
+				break;
+			}
+			if (framing == INCOMPLETE)
+			{
+				lock.row = (edge == _edges.size() - 1) ? HANDOFF : GROWING;
+				break;
+			}
+			lock.inverse = inverse;
+			lock.characters.push_back(ch);
+			if (next == _edges.size())
+			{
+				break;
+			}
+			edge = next;
+		}
+
+		if (lock.row == BROKEN && lock.characters.size() < count)
+		{
+			// this edge does not start a long enough row of characters, whatever comes later
+			continue;
+		}
+		// a growing row has to wait for more edges before later ones are tried
+		return lock.characters.size() >= count;
+	}
+	return false;
+}
+
+Iso7816CharacterLock::Framing Iso7816CharacterLock::ReadCharacter(std::size_t edge, double samplesPerEtu, u64 end, Character& ch, bool& inverse, std::size_t& next) const
+{
+	u64 start = _edges[edge];
+	if (edge > 0 && start - _edges[edge - 1] < IDLE_BEFORE_START * samplesPerEtu)
+	{
+		return INVALID;
+	}
+	u64 guard = start + static_cast<u64>((FRAMED_BITS - 0.5) * samplesPerEtu);
+	if (guard > end)
+	{
+		return INCOMPLETE;
+	}
+
+	// every edge up to the guard time lies on a bit boundary, the levels between them are the bits
+	ch.start = start;
+	ch.line = 0;
+	std::size_t current = edge;
+	for (int bit = 1; bit < FRAMED_BITS; bit++)
+	{
+		u64 centre = start + static_cast<u64>((bit + 0.5) * samplesPerEtu);
+		while (current + 1 < _edges.size() && _edges[current + 1] <= centre)
+		{
+			current++;
+			double offset = (_edges[current] - start) / samplesPerEtu;
+			if (std::fabs(offset - std::floor(offset + 0.5)) > BIT_BOUNDARY_TOLERANCE)
+			{
+				return INVALID;
+			}
+		}
+		bool high = IsHighAfter(current);
+		if (bit == FRAMED_BITS - 1)
+		{
+			if (!high) return INVALID;
+		}
+		else
+		{
+			ch.line = (ch.line << 1) | (high ? 1 : 0);
+		}
+	}
+	next = current + 1;
+
+	// the parity holds in one of the conventions only
+	inverse = !CharacterTable::Direct()[ch.line].parity;
+	return VALID;
+}
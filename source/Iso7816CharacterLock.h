@@ -0,0 +1,88 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef ISO7816_CHARACTER_LOCK_H
+#define ISO7816_CHARACTER_LOCK_H
+
+#include <memory>
+#include <vector>
+
+// Finds the character framing from I/O edges alone, for decoding without TS to start from.
+// A falling edge starts a character when the edges inside fall on bit boundaries, the guard time
+// is HIGH and the parity holds in the same convention for a number of characters in a row.
+class Iso7816CharacterLock
+{
+public:
+	typedef std::shared_ptr<Iso7816CharacterLock> ptr;
+	typedef unsigned long long int u64;
+
+	struct Character
+	{
+		u64 start;				// falling edge of the start bit
+		unsigned short line;	// data bits followed by parity as seen on I/O, first received is MSB
+	};
+
+	enum Row
+	{
+		GROWING,	// the last character is not complete yet
+		HANDOFF,	// the last edge added starts the character following the row
+		BROKEN		// the edge following the row does not start a character
+	};
+
+	struct Lock
+	{
+		bool inverse;
+		std::vector<Character> characters;
+		Row row;
+		std::size_t resume;		// BROKEN: the edge the search goes on from
+	};
+
+	static Iso7816CharacterLock::ptr factory(bool initialHigh);
+	virtual ~Iso7816CharacterLock();
+
+	void AddEdge(u64 pos);
+	// keeps the newest edges only, the search starts over
+	void Drop(std::size_t edges);
+	std::size_t GetEdgeCount() const
+	{
+		return _edges.size();
+	}
+
+	// the shortest runs on I/O are single bits, the others refine the estimate
+	bool EstimateEtu(double& samplesPerEtu) const;
+	// at least `count` characters in a row, the line is known up to `end`
+	bool Find(double samplesPerEtu, std::size_t count, u64 end, Lock& lock);
+
+protected:
+	Iso7816CharacterLock(bool initialHigh);
+
+	enum Framing
+	{
+		VALID,
+		INVALID,
+		INCOMPLETE
+	};
+
+	bool IsHighAfter(std::size_t edge) const
+	{
+		// levels alternate from the initial one
+		return ((edge & 1) != 0) == _initialHigh;
+	}
+	Framing ReadCharacter(std::size_t edge, double samplesPerEtu, u64 end, Character& ch, bool& inverse, std::size_t& next) const;
+
+	bool _initialHigh;
+	std::vector<u64> _edges;
+
+	// falling edges before this one cannot start a character in a row long enough
+	std::size_t _candidate = 0;
+	double _candidateEtu = 0.0;
+};
+
+#endif //ISO7816_CHARACTER_LOCK_H
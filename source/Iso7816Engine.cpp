@@ -0,0 +1,540 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include <algorithm>
+#include "Iso7816Engine.h"
+#include "AllocationCounter.h"
+#include "Logging.hpp"
+#include "Convert.hpp"
+#include "Definitions.hpp"
+#include "Exceptions.hpp"
+#include "TraceBuffer.h"
+
+Iso7816Engine::ptr Iso7816Engine::factory(Iso7816BitDecoder::ptr decoder, Iso7816Output::ptr output, const Config& config)
+{
+	Iso7816Engine::ptr ret(new Iso7816Engine(decoder, output, config));
+	return ret;
+}
+
+Iso7816Engine::Iso7816Engine(Iso7816BitDecoder::ptr decoder, Iso7816Output::ptr output, const Config& config)
+{
+	_decoder = decoder;
+	_output = output;
+	_config = config;
+}
+
+Iso7816Engine::~Iso7816Engine()
+{
+}
+
+void Iso7816Engine::Run()
+{
+	// the capture may start in the middle of a session
+	if (_decoder->IsResetHigh())
+	{
+		DecodeMidStream(0, std::string("M"));
+	}
+
+	int resetCounter = 0;
+	try {
+		for (; ; )
+		{
+			// seek for a RESET going high.
+			ALLOCATION_PHASE(IDLE);
+			LOG_DEBUG("Looking for RST going high...");
+
+			bool high = false;
+			U64 pos = _decoder->SeekForResetEdge(high);
+			resetCounter++;
+
+			DecodeReset(pos, high, std::string("R:") + Convert::ToDec(resetCounter));
+		}
+	}
+	catch (EndOfDataException&)
+	{
+		// recorded edges are over, in Logic the channels wait for more data instead
+		TRACE_EVENT(TraceBuffer::END_OF_DATA, _decoder->GetCursor());
+		LOG_INFO("End of data");
+	}
+}
+
+void Iso7816Engine::DecodeReset(U64 pos, bool high, const std::string& resetName)
+{
+	ALLOCATION_PHASE(IDLE);
+	try {
+		LOG_INFO("%s", resetName.c_str());
+		TRACE_EVENT(TraceBuffer::RESET, pos, high ? 1 : 0);
+
+		if (!high)
+		{
+			ProtocolFrame::ptr frame = TextFrame::factory(_config.resetChannelIndex, resetName, pos, pos + 100);
+			_output->AddProtocolFrame(frame);
+			LOG_DEBUG("Not this time...");
+			return;
+		}
+
+		// log event
+		AddMarker(pos, AnalyzerResults::UpArrow, Iso7816Output::RESET_LINE);
+		LOG_DEBUG("[%llu] Reset detected", pos);
+
+		// discard all serial data until now, and what was learned about the clock
+		_decoder->Restart(pos);
+
+		DecodeStatus status = DecodeAfterReset(pos, resetName);
+		LogStatus(status);
+	}
+	catch (std::exception& ex2)
+	{
+		LOG_ERROR("%s", ex2.what());
+	}
+}
+
+void Iso7816Engine::DecodeMidStream(U64 pos, const std::string& name)
+{
+	ALLOCATION_PHASE(IDLE);
+	try {
+		LOG_INFO("%s", name.c_str());
+		_decoder->Sync(pos);
+
+		DecodeStatus status = DecodeFromLock(pos, name);
+		LogStatus(status);
+	}
+	catch (std::exception& ex2)
+	{
+		LOG_ERROR("%s", ex2.what());
+	}
+}
+
+DecodeStatus Iso7816Engine::DecodeAfterReset(U64 pos, const std::string& resetName)
+{
+	// CLK cycles used to check the clock count into the initial wait
+	std::size_t probed = 0;
+	DecodeStatus status = SelectBitTiming(pos, resetName, probed);
+	if (status.Failed()) return status;
+	std::size_t waitCycles = 400 - probed;
+
+	// 6.2.2 Cold reset
+	U64 fallingIoEdge = 0;
+	Iso7816Session::ptr session;
+	while (true)
+	{
+		/*	At time Tb, RST is put to state H. The answer on I/O shall begin between 400 and 40 000 clock cycles (delay
+			tc) after the rising edge of the signal on RST (at time Tb + tc). If the answer does not begin within 40 000 clock
+			cycles with RST at state H, the interface device shall perform a deactivation.
+		*/
+		status = _decoder->AdvanceClkCycles(waitCycles);
+		if (status.Failed()) return status;
+		pos = status.position;
+		waitCycles = 400;
+		_decoder->Sync(pos);
+
+		// search for first start bit - falling edge
+		status = _decoder->SeekForIoFallingEdge();
+		if (status.Failed()) return status;
+		fallingIoEdge = status.position;
+		DumpLines();
+		_decoder->Sync(fallingIoEdge);
+
+		// sync lines
+		status = _decoder->AdvanceToNextIoEdge();
+		if (status.Failed()) return status;
+		U64 risingIoEdge = status.position;
+		DumpLines();
+
+		// We can use the first up/down dip to measure the baud rate.
+		U64 defaultEtu = 0;
+		if (_decoder->HasClk())
+		{
+			std::size_t cycles = 0;
+			status = _decoder->CountClkCyclesToPosition(risingIoEdge, cycles);
+			if (status.Failed()) return status;
+			defaultEtu = cycles;
+		}
+		else
+		{
+			defaultEtu = _decoder->CalibrateFromStartBit(fallingIoEdge, risingIoEdge);
+		}
+		LOG_DEBUG("[%llu] Found the start bit, initial ETU: %llu clocks...", fallingIoEdge, defaultEtu);
+
+		// default ETU shoud be 372 
+		if (!IsValidETU(defaultEtu))
+		{
+			LOG_DEBUG("[%llu] This is not a valid start bit: %llu clocks...", fallingIoEdge, defaultEtu);
+			TRACE_EVENT(TraceBuffer::INVALID_START_BIT, fallingIoEdge, static_cast<U32>(defaultEtu));
+			session.reset();
+			continue;
+		}
+
+		// sync lines at the I/O rising edge
+		TRACE_EVENT(TraceBuffer::START_BIT, fallingIoEdge, static_cast<U32>(defaultEtu));
+		DumpLines();
+		_decoder->Sync(risingIoEdge);
+
+
+		session = Iso7816Session::factory(_output, defaultEtu, _config.ioChannelIndex, _config.resetChannelIndex);
+
+		AddMarker(fallingIoEdge, AnalyzerResults::DownArrow, Iso7816Output::IO_LINE);
+		AddMarker(fallingIoEdge + ((risingIoEdge - fallingIoEdge) / 2), AnalyzerResults::Start, Iso7816Output::IO_LINE);
+		AddMarker(risingIoEdge, AnalyzerResults::UpArrow, Iso7816Output::IO_LINE);				
+		break;
+	}
+
+	// decode TS byte
+	unsigned char data = 0;
+	status = DecodeByte(session, data);
+	if (status.Failed()) return status;
+
+	U64 endOfByte = _decoder->GetIoPosition();
+	_decoder->Sync(endOfByte);
+	session->PushByte(data, fallingIoEdge, endOfByte);
+
+	return DecodeCharacters(session, fallingIoEdge, false);
+}
+
+DecodeStatus Iso7816Engine::DecodeFromLock(U64 pos, const std::string& name)
+{
+	std::size_t probed = 0;
+	DecodeStatus status = SelectBitTiming(pos, name, probed);
+	if (status.Failed()) return status;
+
+	// I/O edges are collected until characters in a row are framed and the last edge starts the next one,
+	// the decoder takes over from there
+	Iso7816CharacterLock::ptr lock = Iso7816CharacterLock::factory(_decoder->GetIoState() == BIT_HIGH);
+	Iso7816CharacterLock::Lock found;
+	double samplesPerEtu = GetKnownSamplesPerEtu();
+	bool known = samplesPerEtu > 0.0;
+	Iso7816Session::ptr session;
+	for (; ; )
+	{
+		status = _decoder->AdvanceToNextIoEdge();
+		if (status.Failed() && status.code != DecodeStatus::RESET) return status;
+		bool last = status.Failed();
+		if (!last)
+		{
+			lock->AddEdge(status.position);
+		}
+
+		// the ETU is measured once, on enough edges to have single bits among them
+		if (samplesPerEtu <= 0.0 && ((lock->GetEdgeCount() < LOCK_MIN_EDGES && !last) || !lock->EstimateEtu(samplesPerEtu)))
+		{
+			if (last) return status;
+			continue;
+		}
+		if (!lock->Find(samplesPerEtu, LOCK_CHARACTERS, status.position, found))
+		{
+			if (last) return status;
+			if (lock->GetEdgeCount() >= LOCK_MAX_EDGES)
+			{
+				// nothing to lock on so far, the ETU is measured again on newer edges
+				lock->Drop(LOCK_MAX_EDGES / 2);
+				if (!known)
+				{
+					samplesPerEtu = 0.0;
+				}
+			}
+			continue;
+		}
+		if (found.row == Iso7816CharacterLock::GROWING && !last)
+		{
+			continue;
+		}
+
+		if (!session)
+		{
+			U64 etu = UseSamplesPerEtu(samplesPerEtu);
+			session = Iso7816Session::factory(_output, etu, _config.ioChannelIndex, _config.resetChannelIndex);
+			session->StartMidStream(found.inverse, Iso7816Session::Protocol::T0);
+			U64 firstLocked = found.characters.front().start;
+
+			std::string convention = found.inverse ? "inverse" : "direct";
+			LOG_INFO("[%llu] Locked on I/O, ETU: %llu clocks, %s convention", firstLocked, etu, convention.c_str());
+			TRACE_EVENT(TraceBuffer::LOCKED, firstLocked, static_cast<U32>(etu & 0x7FFFFFFF) | (found.inverse ? 0x80000000 : 0));
+			ProtocolFrame::ptr frame = TextFrame::factory(_config.resetChannelIndex, name, name + std::string(" lock"), name + std::string(" locked on I/O, ETU ") + Convert::ToDec(etu) + std::string(", ") + convention + std::string(" convention"), firstLocked, firstLocked + 100);
+			_output->AddProtocolFrame(frame);
+		}
+
+		for (const Iso7816CharacterLock::Character& locked : found.characters)
+		{
+			DecodeStatus pushed = PushLockedCharacter(session, locked, samplesPerEtu);
+			if (pushed.Failed()) return pushed;
+		}
+		if (last) return status;
+
+		if (found.row == Iso7816CharacterLock::HANDOFF)
+		{
+			break;
+		}
+		// the row was broken, the search goes on after it
+		lock->Drop(found.resume);
+	}
+
+	// I/O is right on the falling edge of the next start bit
+	return DecodeCharacters(session, status.position, true);
+}
+
+DecodeStatus Iso7816Engine::DecodeCharacters(Iso7816Session::ptr session, U64 characterStart, bool onStartBit)
+{
+	DecodeStatus status = DecodeStatus::Ok(characterStart);
+	unsigned char data = 0;
+	U64 guard = session->GetCharacterGuard();
+
+	// now we keep waiting for the next 'down'; start bit
+	// and then read our 10 bits, etc, etc.
+	for (;;)
+	{
+		status = onStartBit ? EnterStartBit(session, characterStart) : SeekForNextStartBit(session, characterStart, guard);
+		onStartBit = false;
+		if (!status.Failed())
+		{
+			U64 startPos = _decoder->GetIoPosition();
+			status = DecodeByte(session, data);
+			if (!status.Failed())
+			{
+				// ETU or protocol may change with this character, the shorter guard time is safe for the next one
+				guard = session->GetCharacterGuard();
+				session->PushByte(data, startPos, _decoder->GetIoPosition());
+				guard = std::min(guard, session->GetCharacterGuard());
+				continue;
+			}
+		}
+
+		switch (status.code)
+		{
+		case DecodeStatus::OUT_OF_SYNC:
+			AddMarker(status.position, AnalyzerResults::ErrorDot, Iso7816Output::IO_LINE);
+			LOG_DEBUG("[%llu] Out of sync with start bit.", status.position);
+			TRACE_EVENT(TraceBuffer::OUT_OF_SYNC, status.position);
+			continue;
+		case DecodeStatus::PARITY:
+			AddMarker(status.position, AnalyzerResults::ErrorDot, Iso7816Output::IO_LINE);
+			LOG_DEBUG("[%llu] Parity error", status.position);
+			TRACE_EVENT(TraceBuffer::PARITY_ERROR, status.position);
+			return status;
+		case DecodeStatus::ERROR_SIGNAL:
+			LOG_DEBUG("[%llu] Stop bit not high.", status.position);
+			TRACE_EVENT(TraceBuffer::ERROR_SIGNAL, status.position);
+			AddMarker(status.position, AnalyzerResults::ErrorDot, Iso7816Output::IO_LINE);
+			return status;
+		default:
+			return status;
+		}
+	}
+}
+
+DecodeStatus Iso7816Engine::SeekForNextStartBit(Iso7816Session::ptr session, U64& characterStart, U64 guard)
+{
+	// falling edge -- beginning of the start bit, it cannot come before the guard time is over
+	DecodeStatus status = _decoder->SeekForStartBit(characterStart, guard);
+	if (status.code == DecodeStatus::GUARD_TIME)
+	{
+		AddMarker(status.position, AnalyzerResults::ErrorSquare, Iso7816Output::IO_LINE);
+		LOG_DEBUG("[%llu] Guard time violation", status.position);
+		TRACE_EVENT(TraceBuffer::GUARD_TIME, status.position);
+		status = _decoder->SeekForIoFallingEdge();
+	}
+	if (status.Failed()) return status;
+	characterStart = status.position;
+	return EnterStartBit(session, characterStart);
+}
+
+DecodeStatus Iso7816Engine::EnterStartBit(Iso7816Session::ptr session, U64 fallingIoEdge)
+{
+	_decoder->Sync(fallingIoEdge);
+	DecodeStatus status = _decoder->AdvanceClkCycles(session->GetEtu());
+	if (status.Failed()) return status;
+	U64 endOfStartBit = status.position;
+	AddStartBitMarkers(fallingIoEdge, endOfStartBit);
+	_decoder->Sync(endOfStartBit);
+	return status;
+}
+
+
+DecodeStatus Iso7816Engine::DecodeByte(Iso7816Session::ptr session, unsigned char& data)
+{
+	Iso7816BitDecoder::Character ch;
+	DecodeStatus status = _decoder->ReadCharacter(session->GetEtu(), ch);
+	if (status.Failed()) return status;
+	return DecodeCharacter(session, ch, data);
+}
+
+DecodeStatus Iso7816Engine::DecodeCharacter(Iso7816Session::ptr session, const Iso7816BitDecoder::Character& ch, unsigned char& data)
+{
+	for (int i = 0; i <= 7; i++) {
+		U8 bit = (ch.line >> (8 - i)) & 1;
+		AddMarker(ch.bitCentres[i], bit ? AnalyzerResults::One : AnalyzerResults::Zero, Iso7816Output::IO_LINE);
+		TRACE_EVENT(TraceBuffer::BIT, ch.bitCentres[i], bit);
+	};
+
+	// now we are right on parity bit
+	U64 pos = ch.bitCentres[8];
+	const CharacterTable::Entry* character = session->Decode(ch.line);
+	if (character == nullptr)
+	{
+		return DecodeStatus::Failure(DecodeStatus::INVALID_TS, pos);
+	}
+	data = character->value;
+
+	TRACE_EVENT(TraceBuffer::CHARACTER, pos, data | (character->parity ? 0x100 : 0));
+
+	AddMarker(pos, character->parity ? AnalyzerResults::X : AnalyzerResults::ErrorX, Iso7816Output::IO_LINE);
+
+	// 7.3 Error signal and character repetition
+	/*	As shown in Figure 9, when character parity is incorrect, the receiver shall transmit an error signal on the
+		electrical circuit I/O. Then the receiver shall expect a repetition of the character.
+	*/
+	pos = ch.bitCentres[9];
+	if (!ch.guardHigh)
+	{
+		return DecodeStatus::Failure(DecodeStatus::ERROR_SIGNAL, pos);
+	};
+
+	_output->AddMarker(pos, AnalyzerResults::Stop, Iso7816Output::IO_LINE);
+	return DecodeStatus::Ok(pos);
+}
+
+DecodeStatus Iso7816Engine::PushLockedCharacter(Iso7816Session::ptr session, const Iso7816CharacterLock::Character& locked, double samplesPerEtu)
+{
+	// the character was already read from the edges, bit centres follow from the start bit
+	Iso7816BitDecoder::Character ch;
+	for (int i = 0; i < Iso7816BitDecoder::CHARACTER_BITS; i++)
+	{
+		ch.bitCentres[i] = locked.start + static_cast<U64>((i + 1.5) * samplesPerEtu);
+	}
+	ch.line = locked.line;
+	ch.guardHigh = true;
+
+	AddStartBitMarkers(locked.start, locked.start + static_cast<U64>(samplesPerEtu));
+	unsigned char data = 0;
+	DecodeStatus status = DecodeCharacter(session, ch, data);
+	if (status.Failed()) return status;
+	session->PushByte(data, locked.start + static_cast<U64>(samplesPerEtu), ch.bitCentres[Iso7816BitDecoder::CHARACTER_BITS - 1]);
+	return status;
+}
+
+bool Iso7816Engine::IsValidETU(U64 ea)
+{
+	return ea > DEF_ETU_MIN && ea < DEF_ETU_MAX;
+}
+
+DecodeStatus Iso7816Engine::SelectBitTiming(U64 pos, const std::string& resetName, std::size_t& probed)
+{
+	probed = 0;
+	std::string mode;
+	std::string details;
+
+	if (!_decoder->HasClkChannel())
+	{
+		ConfigureSampleTiming();
+		mode = "SMP";
+		details = "samples, no CLK";
+	}
+	else
+	{
+		// with the sample rate too close to the card clock CLK edges alias, bits have to be timed in samples
+		_decoder->UseClk(true);
+		Iso7816BitDecoder::ClkProbe probe;
+		DecodeStatus status = _decoder->ProbeClk(CLK_PROBE_CYCLES, probe);
+		if (status.Failed()) return status;
+		probed = CLK_PROBE_CYCLES + 1;
+
+		// the percentage is the margin of the choice, in both modes: 0% right at the limits, 100% sure
+		std::string measured = Convert::ToDec(probe.samplesPerClk, 2) + std::string(" samples/cycle, ") + Convert::ToDec(probe.regularity) + std::string("% regular");
+		std::string margin = Convert::ToDec(probe.margin) + std::string("%");
+		std::string limits = std::string(" (margin ") + margin + std::string(" from the limits of ") + Convert::ToDec(MIN_SAMPLES_PER_CLK)
+			+ std::string(" samples/cycle and ") + Convert::ToDec(MIN_CLK_REGULARITY) + std::string("% regular)");
+		if (probe.usable)
+		{
+			mode = std::string("CLK ") + margin;
+			details = std::string("CLK, ") + measured + limits;
+		}
+		else
+		{
+			_decoder->UseClk(false);
+			ConfigureSampleTiming();
+			mode = std::string("SMP ") + margin;
+			details = std::string("samples, CLK unreliable: ") + measured + limits;
+		}
+	}
+
+	LOG_INFO("[%llu] Bit timing: %s", pos, details.c_str());
+	TRACE_EVENT(TraceBuffer::BIT_TIMING, pos, static_cast<U32>(_decoder->GetCurrentSamplesPerClk() * 1000.0 + 0.5));
+	ProtocolFrame::ptr frame = TextFrame::factory(_config.resetChannelIndex, resetName, resetName + std::string(" ") + mode, resetName + std::string(" timing: ") + details, pos, pos + 100);
+	_output->AddProtocolFrame(frame);
+	return DecodeStatus::Ok(pos);
+}
+
+void Iso7816Engine::ConfigureSampleTiming()
+{
+	// ETU measured in samples, either from the configured CLK frequency or the TS start bit
+	double samplesPerClk = 0.0;
+	if (_config.clkFrequency > 0)
+	{
+		samplesPerClk = static_cast<double>(_config.sampleRate) / _config.clkFrequency;
+	}
+	_decoder->SetSamplesPerClk(samplesPerClk);
+}
+
+double Iso7816Engine::GetKnownSamplesPerEtu()
+{
+	// a configured ETU helps only when the clock period is known as well
+	double samplesPerClk = _decoder->GetCurrentSamplesPerClk();
+	if (_config.etu == 0 || samplesPerClk <= 0.0)
+	{
+		return 0.0;
+	}
+	return _config.etu * samplesPerClk;
+}
+
+U64 Iso7816Engine::UseSamplesPerEtu(double samplesPerEtu)
+{
+	double samplesPerClk = _decoder->GetCurrentSamplesPerClk();
+	if (samplesPerClk <= 0.0)
+	{
+		// neither CLK nor its frequency known, the ETU is timed in samples as the default one
+		_decoder->UseClk(false);
+		samplesPerClk = samplesPerEtu / DEF_ETU;
+		_decoder->SetSamplesPerClk(samplesPerClk);
+	}
+	return static_cast<U64>(samplesPerEtu / samplesPerClk + 0.5);
+}
+
+void Iso7816Engine::LogStatus(const DecodeStatus& status)
+{
+	switch (status.code)
+	{
+	case DecodeStatus::RESET:
+		LOG_DEBUG("[%llu] Found RESET line change", status.position);
+		break;
+	case DecodeStatus::INVALID_TS:
+		LOG_DEBUG("[%llu] The first byte shoud be C0h (INVERSE) or DCh (DIRECT) only!", status.position);
+		TRACE_EVENT(TraceBuffer::INVALID_TS, status.position);
+		break;
+	default:
+		break;
+	}
+}
+
+void Iso7816Engine::AddMarker(U64 position, AnalyzerResults::MarkerType mt, Iso7816Output::Line line)
+{
+	_output->AddMarker(position, mt, line);
+	_output->Commit();
+}
+
+void Iso7816Engine::AddStartBitMarkers(U64 fallingIoEdge, U64 endOfStartBit)
+{
+	AddMarker(fallingIoEdge, AnalyzerResults::DownArrow, Iso7816Output::IO_LINE);
+	AddMarker(fallingIoEdge + ((endOfStartBit - fallingIoEdge) / 2), AnalyzerResults::Start, Iso7816Output::IO_LINE);
+	AddMarker(endOfStartBit, AnalyzerResults::UpArrow, Iso7816Output::IO_LINE);
+}
+
+void Iso7816Engine::DumpLines()
+{
+	LOG_DEBUG("[%llu] %s", _decoder->GetCursor(), _decoder->DescribeLines().c_str());
+}
@@ -0,0 +1,76 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef ISO7816_ENGINE_H
+#define ISO7816_ENGINE_H
+
+#include <memory>
+#include <string>
+#include <AnalyzerResults.h>
+#include "DecodeStatus.h"
+#include "Iso7816BitDecoder.h"
+#include "Iso7816CharacterLock.h"
+#include "Iso7816Output.h"
+#include "Iso7816Session.h"
+
+// Decodes the lines into markers and frames, one session after every RST rising edge
+class Iso7816Engine
+{
+public:
+	typedef std::shared_ptr<Iso7816Engine> ptr;
+
+	struct Config
+	{
+		unsigned int ioChannelIndex;	// frames of bytes go on I/O
+		unsigned int resetChannelIndex;	// frames of ATR, PPS, T=1 blocks and resets go on RST
+		U64 sampleRate;
+		U32 clkFrequency;				// 0 when not known
+		U32 etu;						// clock cycles per ETU when joining a transmission without reset, 0 to measure it
+	};
+
+	static Iso7816Engine::ptr factory(Iso7816BitDecoder::ptr decoder, Iso7816Output::ptr output, const Config& config);
+	virtual ~Iso7816Engine();
+
+	// decodes reset after reset, as long as there is data
+	void Run();
+	// RST edge already reached by the decoder
+	void DecodeReset(U64 pos, bool high, const std::string& resetName);
+	// joins a transmission at any position, the character framing is found on I/O
+	void DecodeMidStream(U64 pos, const std::string& name);
+
+protected:
+	Iso7816Engine(Iso7816BitDecoder::ptr decoder, Iso7816Output::ptr output, const Config& config);
+
+	DecodeStatus DecodeAfterReset(U64 pos, const std::string& resetName);
+	DecodeStatus DecodeFromLock(U64 pos, const std::string& name);
+	DecodeStatus DecodeCharacters(Iso7816Session::ptr session, U64 characterStart, bool onStartBit);
+	DecodeStatus SeekForNextStartBit(Iso7816Session::ptr session, U64& characterStart, U64 guard);
+	DecodeStatus EnterStartBit(Iso7816Session::ptr session, U64 fallingIoEdge);
+	DecodeStatus DecodeByte(Iso7816Session::ptr session, unsigned char& data);
+	DecodeStatus DecodeCharacter(Iso7816Session::ptr session, const Iso7816BitDecoder::Character& ch, unsigned char& data);
+	DecodeStatus PushLockedCharacter(Iso7816Session::ptr session, const Iso7816CharacterLock::Character& locked, double samplesPerEtu);
+	bool IsValidETU(U64 ea);
+	DecodeStatus SelectBitTiming(U64 pos, const std::string& resetName, std::size_t& probed);
+	void ConfigureSampleTiming();
+	double GetKnownSamplesPerEtu();
+	U64 UseSamplesPerEtu(double samplesPerEtu);
+
+	void LogStatus(const DecodeStatus& status);
+	void AddMarker(U64 position, AnalyzerResults::MarkerType mt, Iso7816Output::Line line);
+	void AddStartBitMarkers(U64 fallingIoEdge, U64 endOfStartBit);
+	void DumpLines();
+
+protected:
+	Iso7816BitDecoder::ptr _decoder;
+	Iso7816Output::ptr _output;
+	Config _config;
+};
+
+#endif //ISO7816_ENGINE_H
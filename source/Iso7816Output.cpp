@@ -0,0 +1,55 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include "Iso7816Output.h"
+
+Iso7816BufferedOutput::ptr Iso7816BufferedOutput::factory()
+{
+	Iso7816BufferedOutput::ptr ret(new Iso7816BufferedOutput());
+	return ret;
+}
+
+Iso7816BufferedOutput::Iso7816BufferedOutput()
+{
+}
+
+void Iso7816BufferedOutput::AddMarker(u64 pos, AnalyzerResults::MarkerType mt, Line line)
+{
+	Entry entry = { pos, mt, line, ProtocolFrame::ptr() };
+	_entries.push_back(entry);
+}
+
+void Iso7816BufferedOutput::AddProtocolFrame(ProtocolFrame::ptr frame)
+{
+	Entry entry = { 0, AnalyzerResults::Dot, IO_LINE, frame };
+	_entries.push_back(entry);
+}
+
+void Iso7816BufferedOutput::Commit()
+{
+	// committed when replayed
+}
+
+void Iso7816BufferedOutput::Replay(Iso7816Output& output)
+{
+	for (const Entry& entry : _entries)
+	{
+		if (entry.frame)
+		{
+			output.AddProtocolFrame(entry.frame);
+		}
+		else
+		{
+			output.AddMarker(entry.pos, entry.mt, entry.line);
+		}
+	}
+	output.Commit();
+	_entries.clear();
+}
@@ -0,0 +1,68 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef ISO7816_OUTPUT_H
+#define ISO7816_OUTPUT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <AnalyzerResults.h>
+#include "ProtocolFrames.h"
+
+// Receives what the decoder finds: markers on I/O and RST lines and protocol frames
+class Iso7816Output
+{
+public:
+	typedef std::shared_ptr<Iso7816Output> ptr;
+	typedef unsigned long long int u64;
+
+	enum Line
+	{
+		IO_LINE,
+		RESET_LINE
+	};
+
+	virtual ~Iso7816Output()
+	{
+	}
+
+	virtual void AddMarker(u64 pos, AnalyzerResults::MarkerType mt, Line line) = 0;
+	virtual void AddProtocolFrame(ProtocolFrame::ptr frame) = 0;
+	virtual void Commit() = 0;
+};
+
+// Keeps the output of a segment decoded on its own, so it can be replayed in sample order
+class Iso7816BufferedOutput : public Iso7816Output
+{
+public:
+	typedef std::shared_ptr<Iso7816BufferedOutput> ptr;
+	static Iso7816BufferedOutput::ptr factory();
+
+	virtual void AddMarker(u64 pos, AnalyzerResults::MarkerType mt, Line line);
+	virtual void AddProtocolFrame(ProtocolFrame::ptr frame);
+	virtual void Commit();
+
+	void Replay(Iso7816Output& output);
+
+protected:
+	Iso7816BufferedOutput();
+
+	struct Entry
+	{
+		u64 pos;
+		AnalyzerResults::MarkerType mt;
+		Line line;
+		ProtocolFrame::ptr frame;	// null for markers
+	};
+	std::vector<Entry> _entries;
+};
+
+#endif //ISO7816_OUTPUT_H
@@ -0,0 +1,146 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "Iso7816ParallelDecoder.h"
+#include "Iso7816BitDecoder.h"
+#include "Convert.hpp"
+#include "Logging.hpp"
+
+Iso7816ParallelDecoder::ptr Iso7816ParallelDecoder::factory(ChannelProvider provider, Iso7816Output::ptr output, const Iso7816Engine::Config& config, unsigned int threads)
+{
+	Iso7816ParallelDecoder::ptr ret(new Iso7816ParallelDecoder(provider, output, config, threads));
+	return ret;
+}
+
+Iso7816ParallelDecoder::Iso7816ParallelDecoder(ChannelProvider provider, Iso7816Output::ptr output, const Iso7816Engine::Config& config, unsigned int threads)
+	: _provider(provider), _output(output), _config(config), _threads(threads)
+{
+	if (_threads == 0)
+		_threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+Iso7816ParallelDecoder::~Iso7816ParallelDecoder()
+{
+}
+
+bool Iso7816ParallelDecoder::IndexSegments()
+{
+	// cheap pass over RST alone, the segments are decoded later
+	Channels channels;
+	if (!_provider(channels))
+		return false;
+
+	ChannelSource::ptr reset = channels.reset;
+	bool highAtStart = reset->GetBitState() == BIT_HIGH;
+	std::vector<u64> edges;
+	while (reset->DoMoreTransitionsExistInCurrentData())
+	{
+		reset->AdvanceToNextEdge();
+		edges.push_back(reset->GetSampleNumber());
+	}
+	LOG_INFO("RST edges found: %llu", static_cast<unsigned long long>(edges.size()));
+
+	_segments.clear();
+	if (highAtStart)
+	{
+		// the capture starts in the middle of a session
+		Segment segment = { 0, false, true, 0 };
+		_segments.push_back(segment);
+	}
+	for (std::size_t i = 0; i < edges.size(); i++)
+	{
+		// RST levels alternate from the one at the start
+		bool high = ((i & 1) == 0) != highAtStart;
+		Segment segment = { edges[i], true, high, i + 1 };
+		_segments.push_back(segment);
+	}
+	return true;
+}
+
+bool Iso7816ParallelDecoder::DecodeSegment(std::size_t index, Iso7816BufferedOutput::ptr output)
+{
+	const Segment& segment = _segments[index];
+	std::string name = (segment.reset > 0) ? std::string("R:") + Convert::ToDec((u64)segment.reset) : std::string("M");
+
+	Channels channels;
+	if (!_provider(channels))
+		return false;
+
+	Iso7816BitDecoder::ptr decoder = Iso7816BitDecoder::factory(channels.io, channels.reset, channels.vcc, channels.clk);
+	decoder->StartAt(segment.start);
+
+	// a segment ends on the next RST edge, reported by the decoder as a reset
+	Iso7816Engine::ptr engine = Iso7816Engine::factory(decoder, output, _config);
+	if (segment.afterReset)
+		engine->DecodeReset(segment.start, segment.high, name);
+	else
+		engine->DecodeMidStream(segment.start, name);
+	return true;
+}
+
+bool Iso7816ParallelDecoder::Run()
+{
+	if (!IndexSegments())
+		return false;
+
+	std::size_t count = _segments.size();
+	std::vector<Iso7816BufferedOutput::ptr> outputs;
+	for (std::size_t i = 0; i < count; i++)
+		outputs.push_back(Iso7816BufferedOutput::factory());
+
+	std::vector<char> done(count, 0);
+	std::mutex mutex;
+	std::condition_variable finished;
+	std::atomic<std::size_t> next(0);
+	std::atomic<bool> failed(false);
+
+	auto worker = [&]()
+	{
+		for (; ; )
+		{
+			std::size_t index = next++;
+			if (index >= count)
+				break;
+
+			if (!failed && !DecodeSegment(index, outputs[index]))
+				failed = true;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			done[index] = 1;
+			finished.notify_one();
+		}
+	};
+
+	std::vector<std::thread> pool;
+	unsigned int threads = (unsigned int)std::min<std::size_t>(_threads, count);
+	for (unsigned int i = 0; i < threads; i++)
+		pool.push_back(std::thread(worker));
+
+	// merge in sample order as soon as the earliest pending segment is ready
+	for (std::size_t i = 0; i < count; i++)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [&]() { return done[i] != 0; });
+		lock.unlock();
+
+		outputs[i]->Replay(*_output);
+		outputs[i].reset();
+	}
+
+	for (std::thread& thread : pool)
+		thread.join();
+
+	return !failed;
+}
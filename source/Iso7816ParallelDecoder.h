@@ -0,0 +1,73 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef ISO7816_PARALLEL_DECODER_H
+#define ISO7816_PARALLEL_DECODER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "ChannelSource.h"
+#include "Iso7816Engine.h"
+#include "Iso7816Output.h"
+
+// Splits the capture on RST edges and decodes the segments on a pool of threads.
+// Every segment needs its own set of channel cursors, the output is merged in sample order.
+// A capture starting after the reset has its first session found by the character framing on I/O.
+// Sessions are never cut: bit timing, convention, protocol and the block in progress depend on
+// everything decoded since the reset.
+class Iso7816ParallelDecoder
+{
+public:
+	typedef std::shared_ptr<Iso7816ParallelDecoder> ptr;
+	typedef unsigned long long int u64;
+
+	struct Channels
+	{
+		ChannelSource::ptr io;
+		ChannelSource::ptr reset;
+		ChannelSource::ptr vcc;
+		ChannelSource::ptr clk;		// null when not recorded
+	};
+	// opens a fresh set of cursors at the beginning of the capture, false when not possible
+	typedef std::function<bool(Channels& channels)> ChannelProvider;
+
+	struct Segment
+	{
+		u64 start;
+		bool afterReset;	// starts on a RST edge, otherwise the character framing is found on I/O
+		bool high;			// direction of the RST edge
+		std::size_t reset;	// number of the reset, 0 before the first one
+	};
+
+	static Iso7816ParallelDecoder::ptr factory(ChannelProvider provider, Iso7816Output::ptr output, const Iso7816Engine::Config& config, unsigned int threads = 0);
+	virtual ~Iso7816ParallelDecoder();
+
+	// decodes all segments present in the data, false when channels could not be opened
+	bool Run();
+	const std::vector<Segment>& GetSegments() const
+	{
+		return _segments;
+	}
+
+protected:
+	Iso7816ParallelDecoder(ChannelProvider provider, Iso7816Output::ptr output, const Iso7816Engine::Config& config, unsigned int threads);
+
+	bool IndexSegments();
+	bool DecodeSegment(std::size_t index, Iso7816BufferedOutput::ptr output);
+
+	ChannelProvider _provider;
+	Iso7816Output::ptr _output;
+	Iso7816Engine::Config _config;
+	unsigned int _threads;
+	std::vector<Segment> _segments;
+};
+
+#endif //ISO7816_PARALLEL_DECODER_H
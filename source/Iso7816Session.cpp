@@ -9,40 +9,63 @@
 //
 
 #include <memory>
-#include "ISO7816Session.h"
+#include "Iso7816Session.h"
+#include "AllocationCounter.h"
 #include "Convert.hpp"
 #include "Logging.hpp"
 #include "Definitions.hpp"
-#include "iso7816AnalyzerResults.h"
+#include "Iso7816Output.h"
 #include "T1Frame.h"
+#include "TraceBuffer.h"
 
-Iso7816Session::ptr Iso7816Session::factory(iso7816AnalyzerResults::ptr results, Iso7816Session::u64 initialEtu, unsigned int chlBytes, unsigned int chlFrames)
+Iso7816Session::ptr Iso7816Session::factory(Iso7816Output::ptr results, Iso7816Session::u64 initialEtu, unsigned int chlBytes, unsigned int chlFrames)
 {
 	Iso7816Session::ptr ret(new Iso7816Session(results, initialEtu, chlBytes, chlFrames));
 	return ret;
 }
 
-void Iso7816Session::PushByte(unsigned char val, unsigned long long startPos, unsigned long long endPos)
+const CharacterTable::Entry* Iso7816Session::Decode(unsigned short line)
 {
+	if (_transmission)
+	{
+		return &_transmission->Decode(line);
+	}
+
 	if (_state == SessionState::Start)
 	{
-		switch (val)
+		// TS as seen on the line, without the parity bit
+		switch (line >> 1)
 		{
 		case Mode::DIRECT:
+			_table = &CharacterTable::Direct();
 			break;
 		case Mode::INVERSE:
+			_table = &CharacterTable::Inverse();
 			break;
 		default:
-			throw std::runtime_error("The first byte shoud be C0h (INVERSE) or DCh (DIRECT) only!");
+			// the first byte shoud be C0h (INVERSE) or DCh (DIRECT) only
+			return nullptr;
 		}
-		_mode = (Mode)val;
+		_mode = (Mode)(line >> 1);
+	}
+	return &(*_table)[line];
+}
+
+void Iso7816Session::PushByte(unsigned char val, unsigned long long startPos, unsigned long long endPos)
+{
+	ALLOCATION_CHARACTER();
+	if (_state == SessionState::Start)
+	{
 		_state = SessionState::Atr;
 	}
 
-	unsigned char tmp = Transform(val);
-	_buff.push_back(ByteElement(tmp, startPos, endPos));
+	if (_transmission)
+	{
+		_transmission->PushByte(val, startPos, endPos);
+		return;
+	}
 
-	Logging::Write(std::string("data: ") + Convert::ToHex(tmp) + std::string("h"));
+	_buff.push_back(ByteElement(val, startPos, endPos));
 	switch (_state)
 	{
 	case SessionState::Atr:
@@ -51,9 +74,6 @@ void Iso7816Session::PushByte(unsigned char val, unsigned long long startPos, un
 	case SessionState::Pps:
 		OnPps();
 		break;
-	case SessionState::Transmission:
-		OnTransmission();
-		break;
 	case SessionState::Unknown:
 		OnUnknown();
 		break;
@@ -62,28 +82,13 @@ void Iso7816Session::PushByte(unsigned char val, unsigned long long startPos, un
 	}
 }
 
-Iso7816Session::Iso7816Session(iso7816AnalyzerResults::ptr results, Iso7816Session::u64 initialEtu, unsigned int chlBytes, unsigned int chlFrames)
+Iso7816Session::Iso7816Session(Iso7816Output::ptr results, Iso7816Session::u64 initialEtu, unsigned int chlBytes, unsigned int chlFrames)
 {
 	_results = results;
 	_etu = initialEtu;
 	_chlBytes = chlBytes;
 	_chlFrames = chlFrames;
-}
-
-unsigned char Iso7816Session::Transform(unsigned char val)
-{
-	if (_mode == Mode::DIRECT)
-	{
-		return Convert::Msb2Lsb(val);
-	}
-	else if (_mode == Mode::INVERSE)
-	{
-		return ~val;
-	}
-	else
-	{
-		throw std::runtime_error("Unsupported mode: INVERSE or DIRECT only!");
-	}
+	ALLOCATION_PHASE(ATR);
 }
 
 void Iso7816Session::OnAtr()
@@ -103,31 +108,39 @@ void Iso7816Session::OnAtr()
 	if (_atr->Completed())
 	{
 		{
-			ProtocolFrame::ptr frame = TextFrame::factory(_chlFrames, "A", "ATR", _atr->ToString(), _buff[0].GetStartPos(), _buff.rbegin()->GetEndPos());
+			ProtocolFrame::ptr frame = BlockFrame::factory(_chlFrames, BlockFrame::ATR, _buff.ToBytes(), _buff[0].GetStartPos(), _buff.rbegin()->GetEndPos());
 			_results->AddProtocolFrame(frame);
 		}
 
 		// 6.3.1 Selection of transmission parameters and protocol
 		if (_atr->InterfaceByteExists(ISO7816Atr::Tx::TA, 2))
 		{
-			Logging::Write(std::string("Card is in 'specific' mode"));
+			LOG_INFO("Card is in 'specific' mode");
 			// If TA2 (see 8.3) is present in the Answer-to-Reset (card in specific mode), then the interface device shall
 			// start the specific transmission protocol using the specific values of the transmission parameters.
 			unsigned char _ta1 = _atr->GetInterfaceByte(ISO7816Atr::Tx::TA, 1);
 			unsigned char _fi = (_ta1 >> 4) & 0x0f;
 			unsigned char _di = _ta1 & 0x0f;
 			_etu = static_cast<u64>(ISO7816Pps::CalculateETU(_fi, _di));
-			Logging::Write(std::string("The new ETU value is: ") + Convert::ToDec(_etu));
+			LOG_INFO("The new ETU value is: %llu", _etu);
+			TRACE_EVENT(TraceBuffer::ETU, _buff.back().GetEndPos(), static_cast<U32>(_etu));
 
 			unsigned char _ta2 = _atr->GetInterfaceByte(ISO7816Atr::Tx::TA, 2);
 			_prot = (Protocol)(_ta2 & 0x0f);
-			Logging::Write(std::string("Selected protocol is: T") + Convert::ToDec(_prot));
+			LOG_INFO("Selected protocol is: T%d", static_cast<int>(_prot));
+			TRACE_EVENT(TraceBuffer::PROTOCOL, _buff.back().GetEndPos(), static_cast<U32>(_prot));
 
-			_state = SessionState::Transmission;
+			StartTransmission();
 		}
 		else
 		{
+			// the first offered protocol is used unless PPS selects another one
+			if (_atr->InterfaceByteExists(ISO7816Atr::Tx::TD, 1))
+			{
+				_prot = (Protocol)(_atr->GetInterfaceByte(ISO7816Atr::Tx::TD, 1) & 0x0f);
+			}
 			_state = SessionState::Pps;
+			ALLOCATION_PHASE(PPS);
 		}
 		_buff.clear();
 	}
@@ -149,8 +162,9 @@ void Iso7816Session::OnPps()
 	{
 		if (PPS_HEADER != _buff[0].GetValue())
 		{
-			_state = SessionState::Transmission;
-			OnTransmission();
+			StartTransmission();
+			_transmission->PushByte(_buff[0].GetValue(), _buff[0].GetStartPos(), _buff[0].GetEndPos());
+			_buff.clear();
 			return;
 		}
 	}
@@ -182,51 +196,50 @@ void Iso7816Session::OnPps()
 				return;
 			}
 			// they are the same
-			Logging::Write(std::string("PPS detected, fi: ") + Convert::ToDec(frm1->GetFi()) + std::string(", di: ") + Convert::ToDec(frm1->GetDi()));
+			LOG_INFO("PPS detected, fi: %d, di: %d", frm1->GetFi(), frm1->GetDi());
 			_etu = static_cast<u64>(ISO7816Pps::CalculateETU(frm1->GetFi(), frm1->GetDi()));
-			Logging::Write(std::string("New ETU: ") + Convert::ToDec(_etu));
+			LOG_INFO("New ETU: %llu", _etu);
 			_prot = (Protocol)frm1->GetProtocol();
-			Logging::Write(std::string("Selected protocol is: T") + Convert::ToDec(_prot));
+			LOG_INFO("Selected protocol is: T%d", static_cast<int>(_prot));
+
+			u64 ppsEnd = _buff.rbegin()->GetEndPos();
+			TRACE_EVENT(TraceBuffer::PPS, ppsEnd, static_cast<U32>(((frm1->GetFi() & 0x0F) << 4) | (frm1->GetDi() & 0x0F)));
+			TRACE_EVENT(TraceBuffer::ETU, ppsEnd, static_cast<U32>(_etu));
+			TRACE_EVENT(TraceBuffer::PROTOCOL, ppsEnd, static_cast<U32>(_prot));
 
 			{
-				ProtocolFrame::ptr frame = TextFrame::factory(_chlFrames, "P", "PPS", frm1->ToString(), _buff[0].GetStartPos(), _buff.rbegin()->GetEndPos());
+				std::vector<unsigned char> request = _buff.ToBytes();
+				request.resize(static_cast<size_t>(res));
+				ProtocolFrame::ptr frame = BlockFrame::factory(_chlFrames, BlockFrame::PPS, request, _buff[0].GetStartPos(), _buff.rbegin()->GetEndPos());
 				_results->AddProtocolFrame(frame);
 			}
 
 			_buff.erase(_buff.begin(), _buff.begin() + (size_t)res2);
-			_state = SessionState::Transmission;
+			StartTransmission();
+			for (ByteElement t : _buff)
+			{
+				_transmission->PushByte(t.GetValue(), t.GetStartPos(), t.GetEndPos());
+			}
+			_buff.clear();
 			return;
 		}
 	}
 }
 
-void Iso7816Session::OnTransmission()
+void Iso7816Session::StartMidStream(bool inverse, Protocol prot)
 {
-	if (_prot == Protocol::T1)
-	{
-		if (!_txframe)
-		{
-			_txframe = T1Frame::factory();
-		}
-		_txframe->PushData(_buff.rbegin()->GetValue());
-		{
-			//ProtocolFrame::ptr frame = ByteFrame::factory(_chlBytes, _txframe->GetLastElementName(), _buff.back().GetValue(), _buff.back().GetStartPos(), _buff.back().GetEndPos());
-			//_results->AddProtocolFrame(frame);
-		}
-		if (_txframe->Completed())
-		{
-			std::string str = _txframe->ToString();
-			ProtocolFrame::ptr frame = TextFrame::factory(_chlFrames, str, _buff.begin()->GetStartPos(), _buff.rbegin()->GetEndPos());
-			_results->AddProtocolFrame(frame, str.data());
-			_buff.clear();
-			_txframe.reset();
-		}
-	}
-	else
-	{
-		ProtocolFrame::ptr frame = ByteFrame::factory(_chlBytes, _buff.back().GetValue(), _buff.back().GetStartPos(), _buff.back().GetEndPos());
-		_results->AddProtocolFrame(frame);
-	}
+	_mode = inverse ? Mode::INVERSE : Mode::DIRECT;
+	_table = inverse ? &CharacterTable::Inverse() : &CharacterTable::Direct();
+	_prot = prot;
+	StartTransmission();
+}
+
+void Iso7816Session::StartTransmission()
+{
+	// convention and protocol do not change any more, the decoder is specialised on them
+	_transmission = Iso7816Transmission::factory(_mode == Mode::INVERSE, _prot, _results, _chlBytes, _chlFrames);
+	_state = SessionState::Transmission;
+	ALLOCATION_PHASE(TRANSMISSION);
 }
 
 void Iso7816Session::OnUnknown()
@@ -12,10 +12,12 @@
 #define ISO7816_SESSION_H
 
 #include "ByteBuffer.hpp"
+#include "Definitions.hpp"
+#include "CharacterTable.hpp"
 #include "ISO7816Atr.hpp"
 #include "ISO7816Pps.hpp"
-#include "iso7816AnalyzerResults.h"
-#include "TxFrame.h"
+#include "Iso7816Output.h"
+#include "Iso7816Transmission.h"
 
 class Iso7816Session
 {
@@ -45,37 +47,47 @@ public:
 
 public:
 	typedef std::shared_ptr<Iso7816Session> ptr;
-	static Iso7816Session::ptr factory(iso7816AnalyzerResults::ptr results, u64 initialEtu, unsigned int chlBytes, unsigned int chlFrames);
+	static Iso7816Session::ptr factory(Iso7816Output::ptr results, u64 initialEtu, unsigned int chlBytes, unsigned int chlFrames);
 
+	// joins a transmission already going on, convention found on I/O as there is no TS
+	void StartMidStream(bool inverse, Protocol prot);
+
+	// TS selects the convention, following characters are decoded according to it; null for invalid TS
+	const CharacterTable::Entry* Decode(unsigned short line);
 	virtual void PushByte(unsigned char val, unsigned long long startPos, unsigned long long endPos);
 	u64 GetEtu()
 	{
 		return _etu;
 	}
+	// minimum delay between leading edges of two characters in clock cycles
+	u64 GetCharacterGuard()
+	{
+		bool t1 = _state == SessionState::Transmission && _prot == Protocol::T1;
+		return _etu * (t1 ? T1_CHARACTER_GUARD_ETU : CHARACTER_GUARD_ETU);
+	}
 
 protected:
-	Iso7816Session(iso7816AnalyzerResults::ptr results, u64 initialEtu, unsigned int chlBytes, unsigned int chlFrames);
-
-	unsigned char Transform(unsigned char val);
+	Iso7816Session(Iso7816Output::ptr results, u64 initialEtu, unsigned int chlBytes, unsigned int chlFrames);
 
 	void OnAtr();
 	void OnPps();
-	void OnTransmission();
+	void StartTransmission();
 	void OnUnknown();
 
 protected:
 	unsigned int _chlBytes;
 	unsigned int _chlFrames;
-	iso7816AnalyzerResults::ptr _results;
+	Iso7816Output::ptr _results;
 	u64 _etu = 0;
 	ByteBuffer _buff;
 	Mode _mode;
+	const CharacterTable* _table = nullptr;
 	SessionState _state = SessionState::Start;
 	ISO7816Atr::ptr _atr;
 	ISO7816Pps::ptr _pps;
 
-	Protocol _prot;
-	TxFrame::ptr _txframe;
+	Protocol _prot = Protocol::T0;
+	Iso7816Transmission::ptr _transmission;
 };
 
 #endif //ISO7816_SESSION_H
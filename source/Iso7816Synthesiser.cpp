@@ -0,0 +1,502 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include <algorithm>
+#include "Iso7816Synthesiser.h"
+#include "Definitions.hpp"
+#include "ISO7816Pps.hpp"
+
+// hands the edges over to the capture writer
+class EdgeCaptureSink : public Iso7816Synthesiser::Sink
+{
+public:
+	EdgeCaptureSink(EdgeCaptureWriter::ptr writer)
+		: _writer(writer)
+	{
+	}
+
+	virtual void AddEdge(EdgeCapture::Line line, U64 sample)
+	{
+		_writer->AddEdge(line, sample);
+	}
+
+protected:
+	EdgeCaptureWriter::ptr _writer;
+};
+
+Iso7816Synthesiser::ptr Iso7816Synthesiser::factory(const Config& config)
+{
+	Iso7816Synthesiser::ptr ret(new Iso7816Synthesiser(config));
+	return ret;
+}
+
+Iso7816Synthesiser::Iso7816Synthesiser(const Config& config)
+	: _random(config.seed)
+{
+	_config = config;
+	_config.maxPayload = std::max(1u, std::min(_config.maxPayload, 250u));
+	_config.historicalBytes = std::min(_config.historicalBytes, 15u);
+	_config.protocol = _config.protocol != 0 ? 1 : 0;
+	// TA1 is negotiated as it is, values without Fi or Di are not sent
+	if (_config.hasTa1 && ISO7816Pps::CalculateETU((_config.ta1 >> 4) & 0x0f, _config.ta1 & 0x0f) <= 0)
+	{
+		_config.hasTa1 = false;
+	}
+
+	_samplesPerClk = static_cast<double>(_config.sampleRate) / _config.clkFrequency;
+	_recordClk = _config.recordClk && _samplesPerClk >= 2.0;
+	_sequence[READER] = 0;
+	_sequence[CARD] = 0;
+}
+
+Iso7816Synthesiser::~Iso7816Synthesiser()
+{
+}
+
+BitState Iso7816Synthesiser::GetInitialState(EdgeCapture::Line line)
+{
+	// I/O is kept in state H by the interface device
+	return line == EdgeCapture::IO_LINE ? BIT_HIGH : BIT_LOW;
+}
+
+U64 Iso7816Synthesiser::GenerateTo(U64 sample, Sink& sink)
+{
+	while (_horizon < sample && !IsGenerated())
+	{
+		GenerateSession();
+	}
+
+	U64 limit = std::min(sample, _horizon);
+	for (int line = 0; line < EdgeCapture::LINES; line++)
+	{
+		std::deque<U64>& edges = _edges[line];
+		while (!edges.empty() && edges.front() <= limit)
+		{
+			sink.AddEdge(static_cast<EdgeCapture::Line>(line), edges.front());
+			edges.pop_front();
+		}
+	}
+	EmitClk(limit, sink);
+	return limit;
+}
+
+Iso7816Synthesiser::MemorySink::MemorySink()
+{
+	for (int line = 0; line < EdgeCapture::LINES; line++)
+	{
+		_initial[line] = GetInitialState(static_cast<EdgeCapture::Line>(line));
+	}
+}
+
+void Iso7816Synthesiser::MemorySink::AddEdge(EdgeCapture::Line line, U64 sample)
+{
+	_edges[line].push_back(sample);
+}
+
+U64 Iso7816Synthesiser::MemorySink::Generate(Iso7816Synthesiser& synthesiser)
+{
+	_lastSample = synthesiser.GenerateTo(~0ULL, *this);
+	_clkRecorded = synthesiser.IsClkRecorded();
+	return _lastSample;
+}
+
+void Iso7816Synthesiser::MemorySink::Cut(U64 sample)
+{
+	for (int line = 0; line < EdgeCapture::LINES; line++)
+	{
+		std::vector<U64>& edges = _edges[line];
+		std::size_t dropped = std::lower_bound(edges.begin(), edges.end(), sample) - edges.begin();
+		edges.erase(edges.begin(), edges.begin() + dropped);
+		if (dropped & 1)
+		{
+			_initial[line] = _initial[line] == BIT_HIGH ? BIT_LOW : BIT_HIGH;
+		}
+	}
+}
+
+ChannelSource::ptr Iso7816Synthesiser::MemorySink::OpenLine(EdgeCapture::Line line) const
+{
+	if (line == EdgeCapture::CLK_LINE && !_clkRecorded)
+	{
+		return ChannelSource::ptr();
+	}
+	return EdgeChannelSource::factory(_initial[line], _edges[line].data(), _edges[line].size(), _lastSample);
+}
+
+bool Iso7816Synthesiser::IsCompleted() const
+{
+	if (!IsGenerated() || !_clkRuns.empty()) return false;
+	for (int line = 0; line < EdgeCapture::LINES; line++)
+	{
+		if (!_edges[line].empty()) return false;
+	}
+	return true;
+}
+
+bool Iso7816Synthesiser::WriteCapture(const std::string& path)
+{
+	if (_config.sessions == 0) return false;
+
+	EdgeCaptureWriter::ptr writer = EdgeCaptureWriter::factory(_config.sampleRate);
+	for (int line = 0; line < EdgeCapture::LINES; line++)
+	{
+		if (line == EdgeCapture::CLK_LINE && !_recordClk) continue;
+		writer->SetInitialState(static_cast<EdgeCapture::Line>(line), GetInitialState(static_cast<EdgeCapture::Line>(line)));
+	}
+
+	// a session is handed to the writer before the next one is generated
+	EdgeCaptureSink sink(writer);
+	U64 lastSample = 0;
+	while (!IsGenerated())
+	{
+		GenerateSession();
+		lastSample = GenerateTo(_horizon, sink);
+	}
+	return writer->Write(path, lastSample);
+}
+
+void Iso7816Synthesiser::GenerateSession()
+{
+	if (_powered)
+	{
+		WarmReset();
+	}
+	else
+	{
+		PowerUp();
+		ColdReset();
+	}
+
+	SendAtr();
+	if (_config.pps)
+	{
+		SendPps();
+	}
+	else
+	{
+		StartTransmission(_config.hasTd1 || _config.protocol == 1 ? _config.protocol : 0);
+	}
+
+	if (_protocol == 1)
+	{
+		// the reader announces its IFSD first
+		Turnaround(22);
+		SendT1Block(READER, 0xC1, std::vector<U8>(1, 0xFE));
+		Turnaround(22);
+		SendT1Block(CARD, 0xE1, std::vector<U8>(1, 0xFE));
+	}
+	for (U32 i = 0; i < _config.exchanges; i++)
+	{
+		if (_protocol == 1)
+		{
+			SendT1Exchange();
+		}
+		else
+		{
+			SendT0Exchange();
+		}
+	}
+	Turnaround(100);
+
+	_session++;
+	if (IsGenerated() || Random(2) == 0)
+	{
+		PowerDown();
+	}
+	_horizon = static_cast<U64>(GetSample());
+}
+
+void Iso7816Synthesiser::PowerUp()
+{
+	_offSample += 1000 + Random(1000);
+	AddEdge(EdgeCapture::VCC_LINE, _offSample);
+
+	// CLK starts once VCC is stable
+	_offSample += _config.sampleRate / 10000;
+	_clkStart = _offSample;
+	_cycle = 0.0;
+	_clkRunning = true;
+	if (_recordClk)
+	{
+		ClkRun run = { _clkStart, ~0ULL };
+		_clkRuns.push_back(run);
+	}
+	_powered = true;
+}
+
+void Iso7816Synthesiser::PowerDown()
+{
+	AddEdge(EdgeCapture::RST_LINE, GetSample());
+	Wait(100);
+
+	// whole periods, CLK stops LOW
+	if (_recordClk)
+	{
+		_clkRuns.back().edges = 2 * static_cast<U64>(_cycle);
+	}
+	_offSample = _clkStart + static_cast<U64>(_cycle) * _samplesPerClk;
+	_clkRunning = false;
+
+	_offSample += _config.sampleRate / 100000;
+	AddEdge(EdgeCapture::VCC_LINE, _offSample);
+	_offSample += _config.sampleRate / 1000;
+	_powered = false;
+}
+
+void Iso7816Synthesiser::ColdReset()
+{
+	// RST is held LOW for at least 400 clock cycles, ATR starts within 400 to 40000 cycles after it goes HIGH
+	Wait(400 + Random(400));
+	AddEdge(EdgeCapture::RST_LINE, GetSample());
+	Wait(400 + Random(1000));
+
+	_etu = DEF_ETU;
+	_protocol = -1;
+	_sequence[READER] = 0;
+	_sequence[CARD] = 0;
+}
+
+void Iso7816Synthesiser::WarmReset()
+{
+	AddEdge(EdgeCapture::RST_LINE, GetSample());
+	ColdReset();
+}
+
+void Iso7816Synthesiser::SendAtr()
+{
+	bool hasTd1 = _config.hasTd1 || _config.protocol == 1;
+	U8 y1 = (_config.hasTa1 ? 0x10 : 0) | (_config.hasTc1 ? 0x40 : 0) | (hasTd1 ? 0x80 : 0);
+
+	std::vector<U8> atr;
+	atr.push_back(_config.inverse ? 0x3F : 0x3B);
+	atr.push_back(y1 | static_cast<U8>(_config.historicalBytes));
+	if (_config.hasTa1) atr.push_back(_config.ta1);
+	if (_config.hasTc1) atr.push_back(_config.tc1);
+	if (hasTd1 && _config.protocol == 1)
+	{
+		// TD2 offers T=1 with IFSC and BWI/CWI in TA3 and TB3
+		atr.push_back(0x81);
+		atr.push_back(0x31);
+		atr.push_back(0xFE);
+		atr.push_back(0x45);
+	}
+	else if (hasTd1)
+	{
+		atr.push_back(0x00);
+	}
+	for (U32 i = 0; i < _config.historicalBytes; i++)
+	{
+		atr.push_back(static_cast<U8>(0x20 + Random(0x5f)));
+	}
+	if (hasTd1 && _config.protocol == 1)
+	{
+		// TCK covers T0 up to the last historical byte
+		U8 tck = 0;
+		for (std::size_t i = 1; i < atr.size(); i++)
+		{
+			tck ^= atr[i];
+		}
+		atr.push_back(tck);
+	}
+	SendCharacters(CARD, atr);
+}
+
+void Iso7816Synthesiser::SendPps()
+{
+	std::vector<U8> pps;
+	pps.push_back(PPS_HEADER);
+	pps.push_back(static_cast<U8>(_config.protocol) | (_config.hasTa1 ? PPS0_1 : 0));
+	if (_config.hasTa1) pps.push_back(_config.ta1);
+	U8 pck = 0;
+	for (U8 b : pps)
+	{
+		pck ^= b;
+	}
+	pps.push_back(pck);
+
+	Turnaround(16);
+	SendCharacters(READER, pps);
+	Turnaround(16);
+	SendCharacters(CARD, pps);
+
+	if (_config.hasTa1)
+	{
+		_etu = ISO7816Pps::CalculateETU((_config.ta1 >> 4) & 0x0f, _config.ta1 & 0x0f);
+	}
+	StartTransmission(_config.protocol);
+}
+
+void Iso7816Synthesiser::StartTransmission(int protocol)
+{
+	_protocol = protocol;
+}
+
+void Iso7816Synthesiser::SendT0Exchange()
+{
+	static const U8 INSTRUCTIONS[] = { 0xA4, 0xB0, 0xB2, 0xCA, 0xD6, 0xDC, 0xE2, 0x88 };
+	U8 ins = INSTRUCTIONS[Random(sizeof(INSTRUCTIONS))];
+	U8 p3 = static_cast<U8>(1 + Random(_config.maxPayload));
+	// case 3 sends the data to the card, case 2 reads it
+	bool toCard = Random(2) == 0;
+
+	std::vector<U8> header = { 0x00, ins, static_cast<U8>(Random(256)), static_cast<U8>(Random(256)), p3 };
+	std::vector<U8> data(p3);
+	for (U8& b : data)
+	{
+		b = static_cast<U8>(Random(256));
+	}
+	std::vector<U8> status = { 0x90, 0x00 };
+
+	Turnaround(16);
+	SendCharacters(READER, header);
+	Turnaround(16);
+	SendCharacters(CARD, std::vector<U8>(1, ins));
+	if (toCard)
+	{
+		Turnaround(16);
+		SendCharacters(READER, data);
+		Turnaround(16);
+	}
+	else
+	{
+		SendCharacters(CARD, data);
+	}
+	SendCharacters(CARD, status);
+}
+
+void Iso7816Synthesiser::SendT1Exchange()
+{
+	U32 length = 5 + Random(_config.maxPayload);
+	std::vector<U8> command(length);
+	for (U8& b : command)
+	{
+		b = static_cast<U8>(Random(256));
+	}
+	command[0] = 0x00;
+	command[4] = static_cast<U8>(length - 5);
+
+	U32 responseLength = Random(_config.maxPayload) + 2;
+	std::vector<U8> response(responseLength);
+	for (U8& b : response)
+	{
+		b = static_cast<U8>(Random(256));
+	}
+	response[responseLength - 2] = 0x90;
+	response[responseLength - 1] = 0x00;
+
+	Turnaround(22);
+	SendT1Block(READER, static_cast<U8>(_sequence[READER] << 6), command);
+	if (Random(8) == 0)
+	{
+		// the card asks for the block again, as after an EDC error
+		Turnaround(22);
+		SendT1Block(CARD, static_cast<U8>(0x81 | (_sequence[READER] << 4)), std::vector<U8>());
+		Turnaround(22);
+		SendT1Block(READER, static_cast<U8>(_sequence[READER] << 6), command);
+	}
+	Turnaround(22);
+	SendT1Block(CARD, static_cast<U8>(_sequence[CARD] << 6), response);
+
+	_sequence[READER] ^= 1;
+	_sequence[CARD] ^= 1;
+}
+
+void Iso7816Synthesiser::SendT1Block(Direction direction, U8 pcb, const std::vector<U8>& inf)
+{
+	std::vector<U8> block;
+	block.reserve(inf.size() + 4);
+	block.push_back(0x00);
+	block.push_back(pcb);
+	block.push_back(static_cast<U8>(inf.size()));
+	block.insert(block.end(), inf.begin(), inf.end());
+	U8 lrc = 0;
+	for (U8 b : block)
+	{
+		lrc ^= b;
+	}
+	block.push_back(lrc);
+	SendCharacters(direction, block);
+}
+
+void Iso7816Synthesiser::SendCharacters(Direction direction, const std::vector<U8>& data)
+{
+	U32 guard = GetGuardEtu(direction);
+	for (U8 value : data)
+	{
+		// now and then a character comes later than it has to
+		U32 extra = Random(8) == 0 ? Random(4) : 0;
+		// drawn only when asked for, captures of a seed stay the same otherwise
+		bool parityError = _config.parityErrors != 0 && Random(1000000) < _config.parityErrors;
+		SendCharacter(value, guard + extra, parityError);
+	}
+}
+
+void Iso7816Synthesiser::SendCharacter(U8 value, U32 guardEtu, bool parityError)
+{
+	// start bit, 8 data bits and even parity; direct convention sends the LSB first with H for 1,
+	// inverse convention the MSB first with L for 1
+	bool ones = false;
+	SetIo(false, _cycle);
+	for (int i = 0; i < 8; i++)
+	{
+		bool bit = ((_config.inverse ? value >> (7 - i) : value >> i) & 1) != 0;
+		ones ^= bit;
+		SetIo(bit != _config.inverse, _cycle + (i + 1) * _etu);
+	}
+	SetIo((ones != parityError) != _config.inverse, _cycle + 9 * _etu);
+	SetIo(true, _cycle + 10 * _etu);
+	Wait(guardEtu * _etu);
+}
+
+U32 Iso7816Synthesiser::GetGuardEtu(Direction direction)
+{
+	// TC1 adds N ETU to the characters of the interface device once ATR is over, N = 255 is the
+	// minimum of 11 ETU in T=1
+	U32 n = _config.hasTc1 ? _config.tc1 : 0;
+	if (_protocol == 1 && n == 255) return T1_CHARACTER_GUARD_ETU;
+	if (direction == READER && _protocol >= 0 && n != 255) return CHARACTER_GUARD_ETU + n;
+	return CHARACTER_GUARD_ETU;
+}
+
+void Iso7816Synthesiser::Turnaround(U32 minEtu)
+{
+	Wait((minEtu + Random(minEtu)) * _etu);
+}
+
+void Iso7816Synthesiser::AddEdge(EdgeCapture::Line line, double sample)
+{
+	_edges[line].push_back(static_cast<U64>(sample));
+}
+
+void Iso7816Synthesiser::SetIo(bool high, double cycle)
+{
+	if (high == _ioHigh) return;
+	AddEdge(EdgeCapture::IO_LINE, _clkStart + cycle * _samplesPerClk);
+	_ioHigh = high;
+}
+
+U64 Iso7816Synthesiser::EmitClk(U64 sample, Sink& sink)
+{
+	// one edge every half period from the start of every run
+	U64 emitted = 0;
+	while (!_clkRuns.empty())
+	{
+		const ClkRun& run = _clkRuns.front();
+		for (; run.edges == ~0ULL || _clkNext < run.edges; _clkNext++, emitted++)
+		{
+			U64 edge = static_cast<U64>(run.start + _clkNext * _samplesPerClk / 2);
+			if (edge > sample) return emitted;
+			sink.AddEdge(EdgeCapture::CLK_LINE, edge);
+		}
+		_clkRuns.pop_front();
+		_clkNext = 0;
+	}
+	return emitted;
+}
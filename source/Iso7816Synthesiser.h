@@ -0,0 +1,185 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef ISO7816_SYNTHESISER_H
+#define ISO7816_SYNTHESISER_H
+
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <LogicPublicTypes.h>
+#include "EdgeCapture.h"
+
+// Generates the four lines of complete card sessions: power-up, reset, ATR, optional PPS and T=0 or T=1
+// exchanges, then a warm reset or a power-down. The same seed gives the same capture on every platform.
+// Sessions are generated one at a time and handed out edge by edge, as far as the sink asks for them.
+// Asked for everything at once they are all generated first, WriteCapture goes session by session.
+class Iso7816Synthesiser
+{
+public:
+	typedef std::shared_ptr<Iso7816Synthesiser> ptr;
+
+	struct Config
+	{
+		U32 seed = 1;
+		U64 sampleRate = 24000000;
+		U32 clkFrequency = 3571200;
+		bool recordClk = true;			// CLK is left out as well when a clock period is shorter than two samples
+		bool inverse = false;			// TS 3Fh, 3Bh otherwise
+		bool hasTa1 = true;
+		U8 ta1 = 0x13;					// Fi = 372, Di = 4
+		bool hasTc1 = false;
+		U8 tc1 = 0x00;					// extra guard time N
+		bool hasTd1 = true;				// always sent for T=1
+		U32 protocol = 1;
+		U32 historicalBytes = 8;
+		bool pps = true;				// negotiates TA1, the default ETU stays in use otherwise
+		U32 sessions = 1;				// 0 to generate for ever
+		U32 exchanges = 16;				// command / response pairs in a session
+		U32 maxPayload = 64;			// data bytes of a command or a response
+		U32 parityErrors = 0;			// characters in a million sent with a wrong parity bit
+	};
+
+	// receives the edges of every line in ascending order, lines interleave freely
+	class Sink
+	{
+	public:
+		virtual ~Sink()
+		{
+		}
+		virtual void AddEdge(EdgeCapture::Line line, U64 sample) = 0;
+	};
+
+	// keeps all the edges in memory, lines are read through channel sources over them
+	class MemorySink : public Sink
+	{
+	public:
+		MemorySink();
+
+		virtual void AddEdge(EdgeCapture::Line line, U64 sample);
+		// every session of the synthesiser, returns the last sample
+		U64 Generate(Iso7816Synthesiser& synthesiser);
+		// edges before the sample are dropped, the lines start in the state they had there
+		void Cut(U64 sample);
+
+		U64 GetLastSample() const
+		{
+			return _lastSample;
+		}
+		U64 GetEdgeCount(EdgeCapture::Line line) const
+		{
+			return _edges[line].size();
+		}
+		// a new cursor on every call, null for a line not recorded; the sink has to outlive it
+		ChannelSource::ptr OpenLine(EdgeCapture::Line line) const;
+
+	protected:
+		std::vector<U64> _edges[EdgeCapture::LINES];
+		BitState _initial[EdgeCapture::LINES];
+		U64 _lastSample = 0;
+		bool _clkRecorded = true;
+	};
+
+	static Iso7816Synthesiser::ptr factory(const Config& config);
+	virtual ~Iso7816Synthesiser();
+
+	static BitState GetInitialState(EdgeCapture::Line line);
+	bool IsClkRecorded() const
+	{
+		return _recordClk;
+	}
+
+	// hands out the edges up to the sample and returns the sample reached, less than requested once
+	// the last session is over
+	U64 GenerateTo(U64 sample, Sink& sink);
+	bool IsCompleted() const;
+	bool IsGenerated() const
+	{
+		return _config.sessions != 0 && _session >= _config.sessions;
+	}
+	// all the sessions into an edge capture, not for endless generation; one session is kept in memory
+	bool WriteCapture(const std::string& path);
+
+protected:
+	Iso7816Synthesiser(const Config& config);
+
+	enum Direction
+	{
+		READER,
+		CARD
+	};
+
+	struct ClkRun
+	{
+		double start;			// sample of the first rising edge
+		U64 edges;				// ~0 while running
+	};
+
+	void GenerateSession();
+	void PowerUp();
+	void PowerDown();
+	void ColdReset();
+	void WarmReset();
+	void SendAtr();
+	void SendPps();
+	void StartTransmission(int protocol);
+	void SendT0Exchange();
+	void SendT1Exchange();
+	void SendT1Block(Direction direction, U8 pcb, const std::vector<U8>& inf);
+	void SendCharacters(Direction direction, const std::vector<U8>& data);
+	void SendCharacter(U8 value, U32 guardEtu, bool parityError);
+	void Turnaround(U32 minEtu);
+
+	void Wait(double cycles)
+	{
+		_cycle += cycles;
+	}
+	double GetSample() const
+	{
+		return _clkRunning ? _clkStart + _cycle * _samplesPerClk : _offSample;
+	}
+	// std distributions differ between libraries, the modulo does not
+	U32 Random(U32 range)
+	{
+		return static_cast<U32>(_random() % range);
+	}
+	U32 GetGuardEtu(Direction direction);
+	void AddEdge(EdgeCapture::Line line, double sample);
+	void SetIo(bool high, double cycle);
+	U64 EmitClk(U64 sample, Sink& sink);
+
+protected:
+	Config _config;
+	std::mt19937 _random;
+	bool _recordClk;
+	double _samplesPerClk;
+
+	// timing of the session being generated, in clock cycles while CLK runs and in samples otherwise
+	bool _clkRunning = false;
+	double _clkStart = 0.0;
+	double _cycle = 0.0;
+	double _offSample = 0.0;
+	double _etu = 0.0;
+	bool _ioHigh = true;
+	bool _powered = false;
+	int _protocol = -1;			// -1 until ATR and PPS are over
+	U32 _session = 0;
+	U32 _sequence[2];			// N(S) of the reader and of the card
+
+	// generated edges not handed out yet
+	std::deque<U64> _edges[EdgeCapture::LINES];
+	std::deque<ClkRun> _clkRuns;
+	U64 _clkNext = 0;			// edges of the first run already handed out
+	U64 _horizon = 0;			// every line is generated up to it
+};
+
+#endif //ISO7816_SYNTHESISER_H
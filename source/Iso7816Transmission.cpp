@@ -0,0 +1,32 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include "Iso7816Transmission.h"
+
+Iso7816Transmission::ptr Iso7816Transmission::factory(bool inverse, int protocol, Iso7816Output::ptr results, unsigned int chlBytes, unsigned int chlFrames)
+{
+	// protocols other than T=1 are reported byte by byte
+	Iso7816Transmission::ptr ret;
+	if (protocol == 1)
+	{
+		if (inverse)
+			ret.reset(new Iso7816TransmissionT<InverseConvention, T1Protocol>(results, chlBytes, chlFrames));
+		else
+			ret.reset(new Iso7816TransmissionT<DirectConvention, T1Protocol>(results, chlBytes, chlFrames));
+	}
+	else
+	{
+		if (inverse)
+			ret.reset(new Iso7816TransmissionT<InverseConvention, T0Protocol>(results, chlBytes, chlFrames));
+		else
+			ret.reset(new Iso7816TransmissionT<DirectConvention, T0Protocol>(results, chlBytes, chlFrames));
+	}
+	return ret;
+}
@@ -0,0 +1,142 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef ISO7816_TRANSMISSION_H
+#define ISO7816_TRANSMISSION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "CharacterTable.hpp"
+#include "Iso7816Output.h"
+#include "ProtocolFrames.h"
+#include "T1Frame.h"
+
+// Decoder of the transmission phase. Convention and protocol are fixed once ATR/PPS is completed,
+// the session picks the matching instantiation of Iso7816TransmissionT then.
+class Iso7816Transmission
+{
+public:
+	typedef std::shared_ptr<Iso7816Transmission> ptr;
+	typedef unsigned long long int u64;
+
+	static Iso7816Transmission::ptr factory(bool inverse, int protocol, Iso7816Output::ptr results, unsigned int chlBytes, unsigned int chlFrames);
+	virtual ~Iso7816Transmission()
+	{
+	}
+
+	virtual const CharacterTable::Entry& Decode(unsigned short line) = 0;
+	virtual void PushByte(unsigned char val, u64 startPos, u64 endPos) = 0;
+
+protected:
+	Iso7816Transmission()
+	{
+	}
+};
+
+struct DirectConvention
+{
+	static const CharacterTable& Table()
+	{
+		return CharacterTable::Direct();
+	}
+};
+
+struct InverseConvention
+{
+	static const CharacterTable& Table()
+	{
+		return CharacterTable::Inverse();
+	}
+};
+
+// T=0 - every character is reported on its own
+class T0Protocol
+{
+public:
+	typedef unsigned long long int u64;
+
+	T0Protocol(Iso7816Output::ptr results, unsigned int chlBytes, unsigned int /*chlFrames*/)
+		: _results(results), _chlBytes(chlBytes)
+	{
+	}
+
+	void PushByte(unsigned char val, u64 startPos, u64 endPos)
+	{
+		ProtocolFrame::ptr frame = ByteFrame::factory(_chlBytes, val, startPos, endPos);
+		_results->AddProtocolFrame(frame);
+	}
+
+protected:
+	Iso7816Output::ptr _results;
+	unsigned int _chlBytes;
+};
+
+// T=1 - characters are collected into blocks
+class T1Protocol
+{
+public:
+	typedef unsigned long long int u64;
+
+	T1Protocol(Iso7816Output::ptr results, unsigned int /*chlBytes*/, unsigned int chlFrames)
+		: _results(results), _chlFrames(chlFrames)
+	{
+	}
+
+	void PushByte(unsigned char val, u64 startPos, u64 endPos)
+	{
+		if (_bytes.empty())
+		{
+			_startPos = startPos;
+		}
+		_bytes.push_back(val);
+		_block.PushData(val);
+		if (_block.Completed())
+		{
+			// the text of the block is rendered when it is shown
+			ProtocolFrame::ptr frame = BlockFrame::factory(_chlFrames, BlockFrame::T1, _bytes, _startPos, endPos);
+			_results->AddProtocolFrame(frame);
+			_block.Clear();
+			_bytes.clear();
+		}
+	}
+
+protected:
+	Iso7816Output::ptr _results;
+	unsigned int _chlFrames;
+	T1Frame _block;
+	std::vector<unsigned char> _bytes;
+	u64 _startPos = 0;
+};
+
+template <class Convention, class Protocol>
+class Iso7816TransmissionT : public Iso7816Transmission
+{
+public:
+	Iso7816TransmissionT(Iso7816Output::ptr results, unsigned int chlBytes, unsigned int chlFrames)
+		: _protocol(results, chlBytes, chlFrames)
+	{
+	}
+
+	virtual const CharacterTable::Entry& Decode(unsigned short line)
+	{
+		return Convention::Table()[line];
+	}
+
+	virtual void PushByte(unsigned char val, u64 startPos, u64 endPos)
+	{
+		_protocol.PushByte(val, startPos, endPos);
+	}
+
+protected:
+	Protocol _protocol;
+};
+
+#endif //ISO7816_TRANSMISSION_H
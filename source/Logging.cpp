@@ -8,9 +8,8 @@
 //
 
 #include "Logging.hpp"
-#include <iostream>
-#include <sstream>
-#include <iomanip>
+#include <cstdarg>
+#include <cstdio>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -19,17 +18,24 @@
 void Logging::Write(const char *msg)
 {
 #if defined(_WIN32)
-	std::ostringstream tmp;
-	tmp << msg;
-	OutputDebugStringA(tmp.str().c_str());
+	OutputDebugStringA(msg);
+#else
+	std::fputs(msg, stderr);
+	std::fputc('\n', stderr);
 #endif //_WIN32
 }
 
 void Logging::Write(const std::string& msg)
 {
-#if defined(_WIN32)
-	std::ostringstream tmp;
-	tmp << msg.c_str();
-	OutputDebugStringA(tmp.str().c_str());
-#endif //_WIN32
+	Write(msg.c_str());
+}
+
+void Logging::Format(const char* format, ...)
+{
+	char buffer[BUFFER_SIZE];
+	va_list args;
+	va_start(args, format);
+	std::vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	Write(buffer);
 }
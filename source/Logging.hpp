@@ -12,11 +12,54 @@
 #ifndef LOGGING_HPP
 #define LOGGING_HPP
 
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO 2		// resets, bit timing, protocol selection
+#define LOG_LEVEL_DEBUG 3		// start bits, decoding errors, state of the lines
+
+// messages above the level are compiled out together with their arguments; every bit and character
+// goes to the binary trace instead (see TraceBuffer.h). Windows writes errors to the debugger by default,
+// elsewhere messages go to stderr when a level is set
+#ifndef ISO7816_LOG_LEVEL
+#ifdef _WIN32
+#define ISO7816_LOG_LEVEL LOG_LEVEL_ERROR
+#else
+#define ISO7816_LOG_LEVEL LOG_LEVEL_NONE
+#endif //_WIN32
+#endif //ISO7816_LOG_LEVEL
+
+#if ISO7816_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Logging::Format(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) do { } while (false)
+#endif
+#if ISO7816_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) Logging::Format(__VA_ARGS__)
+#else
+#define LOG_INFO(...) do { } while (false)
+#endif
+#if ISO7816_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Logging::Format(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { } while (false)
+#endif
+
+#if defined(__GNUC__)
+#define LOG_FORMAT_CHECK __attribute__((format(printf, 1, 2)))
+#else
+#define LOG_FORMAT_CHECK
+#endif
+
 class Logging
 {
 public:
+	// longer messages are cut
+	static const int BUFFER_SIZE = 512;
+
 	static void Write(const char *msg);
 	static void Write(const std::string& msg);
+	// printf-like, formatted on the stack
+	static void Format(const char* format, ...) LOG_FORMAT_CHECK;
 
 private:
 	Logging();
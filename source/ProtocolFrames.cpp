@@ -12,15 +12,23 @@
 #include <AnalyzerResults.h>
 #include <AnalyzerHelpers.h>
 #include "ProtocolFrames.h"
+#include "Convert.hpp"
+#include "AllocationCounter.h"
+#include "FrameStore.h"
+#include "ISO7816Atr.hpp"
+#include "ISO7816Pps.hpp"
+#include "T1Frame.h"
 
 
 ProtocolFrame::ProtocolFrame(U32 mChannelIndex, S64 mStartingSample, S64 mEndingSample)
 {
-	this->mData1 = reinterpret_cast<U64>(this);
+	// the results put the index of the frame there
+	this->mData1 = 0;
 
 	this->mStartingSampleInclusive = mStartingSample;
 	this->mEndingSampleInclusive = mEndingSample;
 	this->_channelIndex = mChannelIndex;
+	ALLOCATION_FRAME();
 }
 
 
@@ -44,7 +52,6 @@ ProtocolFrame::ptr TextFrame::factory(U32 mChannelIndex, const std::string& strS
 TextFrame::TextFrame(U32 mChannelIndex, const std::string& strShort, S64 mStartingSample, S64 mEndingSample)
 	: ProtocolFrame(mChannelIndex, mStartingSample, mEndingSample)
 {
-	this->mData1 = reinterpret_cast<U64>(this);
 	_short = strShort;
 }
 TextFrame::TextFrame(U32 mChannelIndex, const std::string& strShort, const std::string& strMidium, S64 mStartingSample, S64 mEndingSample)
@@ -61,19 +68,16 @@ TextFrame::TextFrame(U32 mChannelIndex, const std::string& strShort, const std::
 	_detailed = strDetailed;
 }
 
-void TextFrame::RenderBubbleText(AnalyzerResults* ar, Channel& channel, DisplayBase display_base)
+std::string TextFrame::ToString()
 {
-	if (channel.mChannelIndex != this->_channelIndex) return;
+	if (!_detailed.empty()) return _detailed;
+	if (!_midium.empty()) return _midium;
+	return _short;
+}
 
-	ar->AddResultString(_short.c_str());
-	if (!_midium.empty())
-	{
-		ar->AddResultString(_midium.c_str());
-	}
-	if (!_detailed.empty())
-	{
-		ar->AddResultString(_detailed.c_str());
-	}
+std::size_t TextFrame::StoreIn(FrameStore& store)
+{
+	return store.AddText(_channelIndex, _short, _midium, _detailed);
 }
 
 
@@ -90,18 +94,15 @@ ProtocolFrame::ptr ByteFrame::factory(U32 mChannelIndex, std::string name, char
 }
 
 
-void ByteFrame::RenderBubbleText(AnalyzerResults* ar, Channel& channel, DisplayBase display_base)
+std::string ByteFrame::ToString()
 {
-	if (channel.mChannelIndex != this->_channelIndex) return;
+	if (_name.empty()) return Convert::ToHex(_val);
+	return _name + std::string(" ") + Convert::ToHex(_val);
+}
 
-	char number_str[128];
-	AnalyzerHelpers::GetNumberString(_val, display_base, 8, number_str, sizeof(number_str));
-	ar->AddResultString(number_str);
-	if (!_name.empty())
-	{
-		std::string tmp = _name + std::string(" ") + std::string(number_str);
-		ar->AddResultString(tmp.c_str());
-	}
+std::size_t ByteFrame::StoreIn(FrameStore& store)
+{
+	return store.AddByte(_channelIndex, _val, _name);
 }
 
 ByteFrame::ByteFrame(U32 mChannelIndex, unsigned char val, S64 mStartingSample, S64 mEndingSample)
@@ -116,3 +117,107 @@ ByteFrame::ByteFrame(U32 mChannelIndex, std::string name, unsigned char val, S64
 	this->_name = name;
 	this->_val = val;
 }
+
+
+ProtocolFrame::ptr BlockFrame::factory(U32 mChannelIndex, Block block, const std::vector<unsigned char>& bytes, S64 mStartingSample, S64 mEndingSample)
+{
+	ProtocolFrame::ptr ret(new BlockFrame(mChannelIndex, block, bytes, mStartingSample, mEndingSample));
+	return ret;
+}
+
+BlockFrame::BlockFrame(U32 mChannelIndex, Block block, const std::vector<unsigned char>& bytes, S64 mStartingSample, S64 mEndingSample)
+	: ProtocolFrame(mChannelIndex, mStartingSample, mEndingSample), _bytes(bytes)
+{
+	this->_block = block;
+}
+
+std::string BlockFrame::ToString()
+{
+	return Render(_block, _bytes.data(), _bytes.size());
+}
+
+std::size_t BlockFrame::StoreIn(FrameStore& store)
+{
+	return store.AddBlock(_channelIndex, _block, _bytes.data(), _bytes.size());
+}
+
+const char* BlockFrame::GetFrameV2(FrameV2& frameV2)
+{
+	// T=1 blocks go to the data table field by field: NAD, PCB, LEN, INF, LRC
+	if (_block != T1 || _bytes.size() < 4)
+	{
+		return nullptr;
+	}
+	unsigned char lrc = 0;
+	for (unsigned char b : _bytes)
+	{
+		lrc ^= b;
+	}
+	std::size_t infLength = _bytes.size() - 4;
+	frameV2.AddByte("nad", _bytes[0]);
+	frameV2.AddByte("pcb", _bytes[1]);
+	frameV2.AddByte("len", _bytes[2]);
+	frameV2.AddByteArray("inf", _bytes.data() + 3, infLength);
+	frameV2.AddByte("lrc", _bytes.back());
+	frameV2.AddBoolean("lrc_ok", lrc == 0);
+	return "t1";
+}
+
+const char* BlockFrame::GetShortName(Block block)
+{
+	switch (block)
+	{
+	case ATR:
+		return "A";
+	case PPS:
+		return "P";
+	default:
+		return "";
+	}
+}
+
+const char* BlockFrame::GetName(Block block)
+{
+	switch (block)
+	{
+	case ATR:
+		return "ATR";
+	case PPS:
+		return "PPS";
+	default:
+		return "";
+	}
+}
+
+std::string BlockFrame::Render(Block block, const unsigned char* bytes, std::size_t count)
+{
+	// the bytes were parsed once already while decoding, they are parsed again the same way
+	switch (block)
+	{
+	case ATR:
+		{
+			ISO7816Atr::ptr atr = ISO7816Atr::factory();
+			for (std::size_t i = 0; i < count && !atr->Completed(); i++)
+			{
+				atr->PushData(bytes[i]);
+			}
+			return atr->ToString();
+		}
+	case PPS:
+		{
+			ISO7816Pps::ptr pps = ISO7816Pps::DecodeFrame(std::vector<unsigned char>(bytes, bytes + count), 0);
+			return pps ? pps->ToString() : std::string();
+		}
+	case T1:
+		{
+			T1Frame t1;
+			for (std::size_t i = 0; i < count && !t1.Completed(); i++)
+			{
+				t1.PushData(bytes[i]);
+			}
+			return t1.ToString();
+		}
+	default:
+		return std::string();
+	}
+}
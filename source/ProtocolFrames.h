@@ -11,12 +11,27 @@
 #ifndef PROTOCL_FRAMES_H
 #define PROTOCL_FRAMES_H
 
+class FrameStore;
+
 class ProtocolFrame : public Frame
 {
 public:
 	typedef std::shared_ptr<ProtocolFrame> ptr;
 
-	virtual void RenderBubbleText(AnalyzerResults* ar, Channel& channel, DisplayBase display_base) = 0;
+	// the most detailed text, for output outside of Logic
+	virtual std::string ToString() = 0;
+	// copies the frame to the store, the index it got there is returned
+	virtual std::size_t StoreIn(FrameStore& store) = 0;
+	// fills the fields of the data table, the type of the frame is returned or null when there is none
+	virtual const char* GetFrameV2(FrameV2& /*frameV2*/)
+	{
+		return nullptr;
+	}
+
+	U32 GetChannelIndex() const
+	{
+		return _channelIndex;
+	}
 
 protected:
 	ProtocolFrame(U32 mChannelIndex, S64 mStartingSample, S64 mEndingSample);
@@ -32,7 +47,8 @@ public:
 	static ProtocolFrame::ptr factory(U32 mChannelIndex, const std::string& strShort, const std::string& strMidium, S64 mStartingSample, S64 mEndingSample);
 	static ProtocolFrame::ptr factory(U32 mChannelIndex, const std::string& strShort, const std::string& strMidium, const std::string& strDetailed, S64 mStartingSample, S64 mEndingSample);
 
-	void RenderBubbleText(AnalyzerResults* ar, Channel& channel, DisplayBase display_base);
+	std::string ToString();
+	std::size_t StoreIn(FrameStore& store);
 
 private:
 	TextFrame(U32 mChannelIndex, const std::string& strShort, S64 mStartingSample, S64 mEndingSample);
@@ -53,7 +69,8 @@ public:
 	static ProtocolFrame::ptr factory(U32 mChannelIndex, unsigned char val, S64 mStartingSample, S64 mEndingSample);
 	static ProtocolFrame::ptr factory(U32 mChannelIndex, std::string name, char val, S64 mStartingSample, S64 mEndingSample);
 
-	void RenderBubbleText(AnalyzerResults* ar, Channel& channel, DisplayBase display_base);
+	std::string ToString();
+	std::size_t StoreIn(FrameStore& store);
 
 private:
 	ByteFrame(U32 mChannelIndex, unsigned char val, S64 mStartingSample, S64 mEndingSample);
@@ -64,4 +81,34 @@ private:
 	std::string _name;
 };
 
+// ATR, PPS request or T=1 block; only the bytes are kept, the text is rendered from them when asked for
+class BlockFrame : public ProtocolFrame
+{
+public:
+	enum Block
+	{
+		ATR,
+		PPS,
+		T1
+	};
+
+	static ProtocolFrame::ptr factory(U32 mChannelIndex, Block block, const std::vector<unsigned char>& bytes, S64 mStartingSample, S64 mEndingSample);
+
+	std::string ToString();
+	std::size_t StoreIn(FrameStore& store);
+	const char* GetFrameV2(FrameV2& frameV2);
+
+	// short and medium bubble texts, empty when the block has the detailed one only
+	static const char* GetShortName(Block block);
+	static const char* GetName(Block block);
+	static std::string Render(Block block, const unsigned char* bytes, std::size_t count);
+
+private:
+	BlockFrame(U32 mChannelIndex, Block block, const std::vector<unsigned char>& bytes, S64 mStartingSample, S64 mEndingSample);
+
+private:
+	Block _block;
+	std::vector<unsigned char> _bytes;
+};
+
 #endif //PROTOCL_FRAMES_H
@@ -0,0 +1,83 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include "ResultStringCache.h"
+#include <iterator>
+
+ResultStringCache::ptr ResultStringCache::factory(std::size_t capacity)
+{
+	ResultStringCache::ptr ret(new ResultStringCache(capacity));
+	return ret;
+}
+
+ResultStringCache::ResultStringCache(std::size_t capacity)
+	: _capacity(capacity > 0 ? capacity : 1)
+{
+	_index.reserve(_capacity);
+}
+
+ResultStringCache::~ResultStringCache()
+{
+}
+
+const ResultStringCache::Strings* ResultStringCache::Find(U64 frameIndex, U32 channelIndex, DisplayBase displayBase)
+{
+	if (static_cast<int>(displayBase) != _displayBase)
+	{
+		// the strings of the other base will not be asked for until it is selected again
+		Clear();
+		_displayBase = static_cast<int>(displayBase);
+	}
+
+	Key key = { frameIndex, channelIndex, static_cast<int>(displayBase) };
+	auto it = _index.find(key);
+	if (it == _index.end())
+	{
+		_misses++;
+		return nullptr;
+	}
+	_hits++;
+	_entries.splice(_entries.begin(), _entries, it->second);
+	return &it->second->strings;
+}
+
+const ResultStringCache::Strings& ResultStringCache::Insert(U64 frameIndex, U32 channelIndex, DisplayBase displayBase, Strings& strings)
+{
+	Key key = { frameIndex, channelIndex, static_cast<int>(displayBase) };
+	auto it = _index.find(key);
+	if (it != _index.end())
+	{
+		_entries.splice(_entries.begin(), _entries, it->second);
+		it->second->strings.swap(strings);
+		return it->second->strings;
+	}
+
+	if (_entries.size() >= _capacity)
+	{
+		// the least recently used entry is reused, its strings keep their storage
+		_index.erase(_entries.back().key);
+		_entries.splice(_entries.begin(), _entries, std::prev(_entries.end()));
+		_entries.front().key = key;
+	}
+	else
+	{
+		_entries.push_front(Entry());
+		_entries.front().key = key;
+	}
+	_entries.front().strings.swap(strings);
+	_index[key] = _entries.begin();
+	return _entries.front().strings;
+}
+
+void ResultStringCache::Clear()
+{
+	_entries.clear();
+	_index.clear();
+}
@@ -0,0 +1,95 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef RESULT_STRING_CACHE_H
+#define RESULT_STRING_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <AnalyzerResults.h>
+
+// The latest result strings rendered for Logic, by frame, channel and display base. Logic asks for
+// the same visible frames again and again while the view is panned and zoomed; a hit costs a lookup.
+// The least recently used entry goes when the cache is full, all of them when the display base changes.
+class ResultStringCache
+{
+public:
+	typedef std::shared_ptr<ResultStringCache> ptr;
+	typedef std::vector<std::string> Strings;
+
+	// tabular text is not rendered for a channel
+	static const U32 NO_CHANNEL = ~0U;
+	static const std::size_t DEFAULT_CAPACITY = 4096;
+
+	static ResultStringCache::ptr factory(std::size_t capacity = DEFAULT_CAPACITY);
+	virtual ~ResultStringCache();
+
+	// null when not cached
+	const Strings* Find(U64 frameIndex, U32 channelIndex, DisplayBase displayBase);
+	// the strings are swapped in, the caller may get the ones of an evicted entry back
+	const Strings& Insert(U64 frameIndex, U32 channelIndex, DisplayBase displayBase, Strings& strings);
+	void Clear();
+
+	std::size_t GetSize() const
+	{
+		return _entries.size();
+	}
+	U64 GetHits() const
+	{
+		return _hits;
+	}
+	U64 GetMisses() const
+	{
+		return _misses;
+	}
+
+protected:
+	explicit ResultStringCache(std::size_t capacity);
+
+	struct Key
+	{
+		U64 frameIndex;
+		U32 channelIndex;
+		int displayBase;
+
+		bool operator==(const Key& other) const
+		{
+			return frameIndex == other.frameIndex && channelIndex == other.channelIndex && displayBase == other.displayBase;
+		}
+	};
+
+	struct KeyHash
+	{
+		std::size_t operator()(const Key& key) const
+		{
+			return std::hash<U64>()(key.frameIndex ^ (static_cast<U64>(key.channelIndex) << 40) ^ (static_cast<U64>(key.displayBase) << 56));
+		}
+	};
+
+	struct Entry
+	{
+		Key key;
+		Strings strings;
+	};
+
+	// the most recently used first
+	std::list<Entry> _entries;
+	std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> _index;
+	std::size_t _capacity;
+	int _displayBase = -1;
+	U64 _hits = 0;
+	U64 _misses = 0;
+};
+
+#endif //RESULT_STRING_CACHE_H
@@ -0,0 +1,65 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef SALEAE_CHANNEL_SOURCE_H
+#define SALEAE_CHANNEL_SOURCE_H
+
+#include <AnalyzerChannelData.h>
+#include "ChannelSource.h"
+
+// Channel of the running capture in Logic
+class SaleaeChannelSource : public ChannelSource
+{
+public:
+	static ChannelSource::ptr factory(AnalyzerChannelData* channel)
+	{
+		ChannelSource::ptr ret(new SaleaeChannelSource(channel));
+		return ret;
+	}
+
+	virtual U64 GetSampleNumber()
+	{
+		return _channel->GetSampleNumber();
+	}
+	virtual BitState GetBitState()
+	{
+		return _channel->GetBitState();
+	}
+	virtual U32 AdvanceToAbsPosition(U64 sample)
+	{
+		return _channel->AdvanceToAbsPosition(sample);
+	}
+	virtual void AdvanceToNextEdge()
+	{
+		_channel->AdvanceToNextEdge();
+	}
+	virtual U64 GetSampleOfNextEdge()
+	{
+		return _channel->GetSampleOfNextEdge();
+	}
+	virtual bool WouldAdvancingToAbsPositionCauseTransition(U64 sample)
+	{
+		return _channel->WouldAdvancingToAbsPositionCauseTransition(sample);
+	}
+	virtual bool DoMoreTransitionsExistInCurrentData()
+	{
+		return _channel->DoMoreTransitionsExistInCurrentData();
+	}
+
+protected:
+	SaleaeChannelSource(AnalyzerChannelData* channel)
+	{
+		_channel = channel;
+	}
+
+	AnalyzerChannelData* _channel;
+};
+
+#endif //SALEAE_CHANNEL_SOURCE_H
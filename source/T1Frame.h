@@ -82,6 +82,10 @@ public:
 		return TxFrame::ptr(new T1Frame());
 	}
 
+	T1Frame()
+	{
+	}
+
 	virtual ~T1Frame()
 	{
 	}
@@ -136,6 +140,21 @@ public:
 		return _lastElementName;
 	}
 
+	// ready for the next block, INF storage is kept
+	void Clear()
+	{
+		_blockType = Unknown;
+		_sblockData = SBlockData::RFU;
+		_pos = Position::NAD;
+		_nad = 0;
+		_pcb = 0;
+		_len = 0;
+		_inf.clear();
+		_lrc = 0;
+		_xor = 0;
+		_lastElementName.clear();
+	}
+
 	virtual std::string ToString()
 	{
 		std::stringstream ss;
@@ -147,6 +166,8 @@ public:
 			{
 				RenderSBlockData(ss, _sblockData);
 			} break;
+		default:
+			break;
 		}
 
 		RenderTokenWithHexValue(ss, std::string("NAD"), _nad);
@@ -210,10 +231,6 @@ protected:
 	}
 
 private:
-	T1Frame()
-	{
-	}
-
 	void DetermineBlockType(unsigned char data)
 	{
 		unsigned char tmp = data & Definitions::BLOCK_MASK;
@@ -0,0 +1,272 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#include "TraceBuffer.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "Convert.hpp"
+
+static thread_local TraceBuffer* current = nullptr;
+
+// snapshot file: magic, version, record count, then the records in little endian
+static const char SNAPSHOT_MAGIC[8] = { 'I', 'S', 'O', '7', '8', '1', '6', 'T' };
+static const U32 SNAPSHOT_VERSION = 1;
+
+static const char* EVENT_NAMES[TraceBuffer::EVENTS] = {
+	"reset",
+	"bit timing",
+	"start bit",
+	"invalid start",
+	"locked",
+	"bit",
+	"character",
+	"parity error",
+	"error signal",
+	"out of sync",
+	"guard time",
+	"invalid TS",
+	"CLK overrun",
+	"CLK from TS",
+	"PPS",
+	"ETU",
+	"protocol",
+	"end of data",
+};
+
+TraceBuffer::ptr TraceBuffer::factory(std::size_t capacity)
+{
+	TraceBuffer::ptr ret(new TraceBuffer(capacity));
+	return ret;
+}
+
+TraceBuffer::TraceBuffer(std::size_t capacity)
+	: _head(0)
+{
+	std::size_t size = 1;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+	_slots = std::vector<Slot>(size);
+	for (Slot& slot : _slots)
+	{
+		slot.sequence.store(0, std::memory_order_relaxed);
+		slot.position.store(0, std::memory_order_relaxed);
+		slot.data.store(0, std::memory_order_relaxed);
+	}
+	_mask = size - 1;
+}
+
+TraceBuffer::~TraceBuffer()
+{
+}
+
+TraceBuffer::Scope::Scope(TraceBuffer::ptr buffer)
+	: _previous(current), _buffer(buffer)
+{
+	current = _buffer.get();
+}
+
+TraceBuffer::Scope::~Scope()
+{
+	current = _previous;
+}
+
+void TraceBuffer::Add(Event event, U64 position, U32 payload)
+{
+	TraceBuffer* buffer = current;
+	if (buffer != nullptr)
+	{
+		buffer->Write(event, position, payload);
+	}
+}
+
+void TraceBuffer::Write(Event event, U64 position, U32 payload)
+{
+	// single writer: only the readers have to be told about the slot being rewritten
+	U64 index = _head.load(std::memory_order_relaxed);
+	Slot& slot = _slots[index & _mask];
+	slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.position.store(position, std::memory_order_relaxed);
+	slot.data.store((static_cast<U64>(event) << 32) | payload, std::memory_order_relaxed);
+	slot.sequence.store(2 * index + 2, std::memory_order_release);
+	_head.store(index + 1, std::memory_order_release);
+}
+
+std::vector<TraceBuffer::Record> TraceBuffer::Snapshot() const
+{
+	U64 head = _head.load(std::memory_order_acquire);
+	U64 first = head > _slots.size() ? head - _slots.size() : 0;
+
+	std::vector<Record> records;
+	records.reserve(static_cast<std::size_t>(head - first));
+	for (U64 index = first; index < head; index++)
+	{
+		const Slot& slot = _slots[index & _mask];
+		U64 before = slot.sequence.load(std::memory_order_acquire);
+		U64 position = slot.position.load(std::memory_order_relaxed);
+		U64 data = slot.data.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		U64 after = slot.sequence.load(std::memory_order_relaxed);
+		if (before != 2 * index + 2 || after != before)
+		{
+			// the writer has lapped the snapshot
+			continue;
+		}
+
+		Record record;
+		record.position = position;
+		record.payload = static_cast<U32>(data);
+		record.event = static_cast<U16>(data >> 32);
+		record.reserved = 0;
+		records.push_back(record);
+	}
+	return records;
+}
+
+static void PutLittleEndian(std::ostream& out, U64 value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+	{
+		out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+	}
+}
+
+static bool GetLittleEndian(std::istream& in, U64& value, int bytes)
+{
+	unsigned char buffer[8];
+	if (!in.read(reinterpret_cast<char*>(buffer), bytes))
+	{
+		return false;
+	}
+	value = 0;
+	for (int i = bytes - 1; i >= 0; i--)
+	{
+		value = (value << 8) | buffer[i];
+	}
+	return true;
+}
+
+bool TraceBuffer::WriteSnapshot(const std::string& path, const std::vector<Record>& records)
+{
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+	{
+		return false;
+	}
+	out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	PutLittleEndian(out, SNAPSHOT_VERSION, 4);
+	PutLittleEndian(out, records.size(), 8);
+	for (const Record& record : records)
+	{
+		PutLittleEndian(out, record.position, 8);
+		PutLittleEndian(out, record.payload, 4);
+		PutLittleEndian(out, record.event, 2);
+		PutLittleEndian(out, 0, 2);
+	}
+	return out.good();
+}
+
+bool TraceBuffer::ReadSnapshot(const std::string& path, std::vector<Record>& records)
+{
+	std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+	char magic[sizeof(SNAPSHOT_MAGIC)];
+	if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+	{
+		return false;
+	}
+	U64 version = 0;
+	U64 count = 0;
+	if (!GetLittleEndian(in, version, 4) || version != SNAPSHOT_VERSION || !GetLittleEndian(in, count, 8))
+	{
+		return false;
+	}
+
+	records.clear();
+	for (U64 i = 0; i < count; i++)
+	{
+		U64 position = 0, payload = 0, event = 0, reserved = 0;
+		if (!GetLittleEndian(in, position, 8) || !GetLittleEndian(in, payload, 4) || !GetLittleEndian(in, event, 2) || !GetLittleEndian(in, reserved, 2))
+		{
+			return false;
+		}
+		Record record;
+		record.position = position;
+		record.payload = static_cast<U32>(payload);
+		record.event = static_cast<U16>(event);
+		record.reserved = 0;
+		records.push_back(record);
+	}
+	return true;
+}
+
+const char* TraceBuffer::GetEventName(U16 event)
+{
+	return event < EVENTS ? EVENT_NAMES[event] : "unknown";
+}
+
+static std::string DescribeThousandths(U32 value)
+{
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%u.%03u", value / 1000, value % 1000);
+	return buffer;
+}
+
+std::string TraceBuffer::Describe(const Record& record)
+{
+	std::string ret = Convert::ToDec(record.position) + std::string(" ") + GetEventName(record.event);
+	U32 payload = record.payload;
+	switch (record.event)
+	{
+	case RESET:
+		ret += payload != 0 ? std::string(" high") : std::string(" low");
+		break;
+	case BIT_TIMING:
+		ret += payload != 0 ? std::string(", samples/CLK: ") + DescribeThousandths(payload) : std::string(", CLK period not known");
+		break;
+	case CLK_FROM_TS:
+		ret += std::string(", samples/CLK: ") + DescribeThousandths(payload);
+		break;
+	case START_BIT:
+	case INVALID_START_BIT:
+		ret += std::string(", ETU: ") + Convert::ToDec(payload);
+		break;
+	case ETU:
+		ret += std::string(" ") + Convert::ToDec(payload);
+		break;
+	case LOCKED:
+		ret += std::string(", ETU: ") + Convert::ToDec(payload & 0x7FFFFFFF) + ((payload >> 31) != 0 ? std::string(", inverse") : std::string(", direct"));
+		break;
+	case BIT:
+		ret += payload != 0 ? std::string(" 1") : std::string(" 0");
+		break;
+	case CHARACTER:
+		ret += std::string(" ") + Convert::ToHex(static_cast<unsigned char>(payload & 0xFF)) + ((payload & 0x100) != 0 ? std::string("") : std::string(", parity error"));
+		break;
+	case CLK_OVERRUN:
+		ret += std::string(" by ") + Convert::ToDec(payload) + std::string(" edges");
+		break;
+	case PPS:
+		ret += std::string(", FI: ") + Convert::ToDec(payload >> 4) + std::string(", DI: ") + Convert::ToDec(payload & 0x0F);
+		break;
+	case PROTOCOL:
+		ret += std::string(" T=") + Convert::ToDec(payload);
+		break;
+	default:
+		if (payload != 0)
+		{
+			ret += std::string(", payload: ") + Convert::ToDec(payload);
+		}
+		break;
+	}
+	return ret;
+}
@@ -0,0 +1,129 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+#ifndef TRACE_BUFFER_H
+#define TRACE_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <LogicPublicTypes.h>
+
+// Fixed-size ring of binary trace records written by the decode thread. A record is a sample position,
+// an event and a 32-bit payload, writing one takes a few plain stores and never blocks or allocates,
+// so tracing stays on in release builds. When the ring is full the oldest records are overwritten.
+//
+// Records go to the buffer attached to the calling thread (see Scope), threads without one drop them.
+// Any thread can take a snapshot at any time; records overwritten while being copied are left out.
+class TraceBuffer
+{
+public:
+	typedef std::shared_ptr<TraceBuffer> ptr;
+
+	enum Event
+	{
+		RESET,				// payload: 1 RST went high, 0 low
+		BIT_TIMING,			// payload: samples per CLK cycle x 1000, 0 when not known yet
+		START_BIT,			// TS start bit, payload: ETU in clock cycles
+		INVALID_START_BIT,	// payload: ETU in clock cycles
+		LOCKED,				// joined without reset, payload: ETU, bit 31 for the inverse convention
+		BIT,				// payload: the bit
+		CHARACTER,			// payload: data, bit 8 for the parity ok
+		PARITY_ERROR,
+		ERROR_SIGNAL,
+		OUT_OF_SYNC,
+		GUARD_TIME,
+		INVALID_TS,
+		CLK_OVERRUN,		// payload: CLK edges crossed over the prediction
+		CLK_FROM_TS,		// payload: samples per CLK cycle x 1000
+		PPS,				// payload: FI << 4 | DI
+		ETU,				// payload: ETU in clock cycles
+		PROTOCOL,			// payload: T
+		END_OF_DATA,
+		EVENTS
+	};
+
+	struct Record
+	{
+		U64 position;
+		U32 payload;
+		U16 event;
+		U16 reserved;
+	};
+
+	// records kept when not told otherwise, 1 MB of them
+	static const std::size_t DEFAULT_CAPACITY = 1 << 16;
+
+	// the capacity is rounded up to a power of two
+	static TraceBuffer::ptr factory(std::size_t capacity = DEFAULT_CAPACITY);
+	virtual ~TraceBuffer();
+
+	// attaches the buffer to the current thread for the lifetime of the scope
+	class Scope
+	{
+	public:
+		explicit Scope(TraceBuffer::ptr buffer);
+		~Scope();
+
+	private:
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+
+		TraceBuffer* _previous;
+		TraceBuffer::ptr _buffer;
+	};
+
+	// adds a record to the buffer of the calling thread
+	static void Add(Event event, U64 position, U32 payload = 0);
+
+	std::size_t GetCapacity() const
+	{
+		return _slots.size();
+	}
+	// records written so far, overwritten ones included
+	U64 GetWritten() const
+	{
+		return _head.load(std::memory_order_acquire);
+	}
+	// the records still in the ring, oldest first
+	std::vector<Record> Snapshot() const;
+
+	static bool WriteSnapshot(const std::string& path, const std::vector<Record>& records);
+	static bool ReadSnapshot(const std::string& path, std::vector<Record>& records);
+	static const char* GetEventName(U16 event);
+	static std::string Describe(const Record& record);
+
+protected:
+	explicit TraceBuffer(std::size_t capacity);
+
+	void Write(Event event, U64 position, U32 payload);
+
+	// the sequence tells which record the slot holds, it is odd while the slot is being written
+	struct Slot
+	{
+		std::atomic<U64> sequence;
+		std::atomic<U64> position;
+		std::atomic<U64> data;		// event << 32 | payload
+	};
+
+	std::vector<Slot> _slots;
+	std::size_t _mask;
+	std::atomic<U64> _head;
+};
+
+#ifndef ISO7816_NO_TRACE
+#define TRACE_EVENT(...) TraceBuffer::Add(__VA_ARGS__)
+#else
+#define TRACE_EVENT(...) do { } while (false)
+#endif //ISO7816_NO_TRACE
+
+#endif //TRACE_BUFFER_H
@@ -23,15 +23,16 @@
 #include <AnalyzerResults.h>
 #include "Logging.hpp"
 #include "Convert.hpp"
-#include "Util.h"
-#include "Exceptions.hpp"
 #include "SaleaeHelper.hpp"
+#include "SaleaeChannelSource.h"
 #include "Definitions.hpp"
 #include "ISO7816Pps.hpp"
+#include <cstdlib>
 
 iso7816Analyzer::iso7816Analyzer()
 :	Analyzer2(),  
 	mSettings( new iso7816AnalyzerSettings() ),
+	mTrace( TraceBuffer::factory() ),
 	mSimulationInitilized( false )
 {
 	SetAnalyzerSettings( mSettings.get() );
@@ -41,24 +42,38 @@ iso7816Analyzer::iso7816Analyzer()
 iso7816Analyzer::~iso7816Analyzer()
 {
 	KillThread();
+	SaveTrace();
 }
 
 
 void iso7816Analyzer::WorkerThread()
 {
+	TraceBuffer::Scope trace(mTrace);
 	try
 	{
-		Logging::Write("Start");
+		LOG_INFO("Start");
 		_WorkerThread();
-		Logging::Write("Stop");
+		LOG_INFO("Stop");
 	}
 	catch (std::exception &e)
 	{
-		Logging::Write(std::string("[Exception] ") + e.what());
+		LOG_ERROR("[Exception] %s", e.what());
+		SaveTrace();
 	}
 	catch (...)
 	{
-		Logging::Write("[Exception] Unknown error");
+		LOG_ERROR("[Exception] Unknown error");
+		SaveTrace();
+	}
+}
+
+void iso7816Analyzer::SaveTrace()
+{
+	// the trace is kept in memory, ISO7816_TRACE names the file it is written to for iso7816tracedump
+	const char* path = std::getenv("ISO7816_TRACE");
+	if (path != nullptr && *path != '\0' && !TraceBuffer::WriteSnapshot(path, mTrace->Snapshot()))
+	{
+		LOG_ERROR("Cannot write trace: %s", path);
 	}
 }
 
@@ -69,9 +84,9 @@ void iso7816Analyzer::SetupResults()
 	mResults->AddChannelBubblesWillAppearOn(mSettings->mIoChannel);
 	mResults->AddChannelBubblesWillAppearOn(mSettings->mResetChannel);
 
-	Logging::Write(std::string("SimulationSampleRate: ") + Convert::ToDec(GetSimulationSampleRate()));
-	Logging::Write(std::string("SampleRate: ") + Convert::ToDec(GetSampleRate()));
-	Logging::Write(std::string("TriggerSample: ") + Convert::ToDec(GetTriggerSample()));
+	LOG_INFO("SimulationSampleRate: %llu", static_cast<unsigned long long>(GetSimulationSampleRate()));
+	LOG_INFO("SampleRate: %llu", static_cast<unsigned long long>(GetSampleRate()));
+	LOG_INFO("TriggerSample: %llu", static_cast<unsigned long long>(GetTriggerSample()));
 }
 
 void iso7816Analyzer::_WorkerThread()
@@ -79,233 +94,26 @@ void iso7816Analyzer::_WorkerThread()
 	mIo = GetAnalyzerChannelData( mSettings->mIoChannel );
 	mReset = GetAnalyzerChannelData( mSettings->mResetChannel );
 	mVcc = GetAnalyzerChannelData(mSettings->mVccChannel);
-	mClk = GetAnalyzerChannelData(mSettings->mClkChannel);
-
-	Iso7816BitDecoder::ptr decoder = Iso7816BitDecoder::factory(mIo, mReset, mVcc, mClk);
-
-	int resetCounter = 0;
-	for (; ; )
-	{
-		try {
-			// seek for a RESET going high.
-			Logging::Write(std::string("Looking for RST going high..."));
-
-			U64 fallingIoEdge = 0;
-			bool high = false;
-			U64 pos = decoder->SeekForResetEdge(high);
-			resetCounter++;
-
-			{
-				std::string msg = std::string("R:") + Convert::ToDec(resetCounter);
-				Logging::Write(msg);
-				ProtocolFrame::ptr frame = TextFrame::factory(mSettings->mResetChannel.mChannelIndex, msg, pos, pos + 100);
-				mResults->AddProtocolFrame(frame);
-			}
-
-			if (!high)
-			{
-				Logging::Write(std::string("Not this time..."));
-				continue;
-			}
-
-			// log event
-			AddMarker(pos, AnalyzerResults::UpArrow, mSettings->mResetChannel);
-			LogEvent(pos, std::string("Reset detected"));
-
-			// discard all serial data until now.
-			decoder->Sync(pos);
-
-			// 6.2.2 Cold reset
-			Iso7816Session::ptr session;
-			while (true)
-			{
-				/*	At time Tb, RST is put to state H. The answer on I/O shall begin between 400 and 40 000 clock cycles (delay
-					tc) after the rising edge of the signal on RST (at time Tb + tc). If the answer does not begin within 40 000 clock
-					cycles with RST at state H, the interface device shall perform a deactivation.
-				*/
-				pos = decoder->AdvanceClkCycles(400);
-				decoder->Sync(pos);
+	mClk = (mSettings->mClkChannel == UNDEFINED_CHANNEL) ? nullptr : GetAnalyzerChannelData(mSettings->mClkChannel);
 
-				// search for first start bit - falling edge
-				LogEvent(pos, std::string("Seeking for start bit..."));
-				fallingIoEdge = decoder->SeekForIoFallingEdge();
-				DumpLines();
-				decoder->Sync(fallingIoEdge);
-				LogEvent(fallingIoEdge, std::string("Falling I/O edge found"));
-
-				// sync lines
-				U64 risingIoEdge = decoder->AdvanceToNextIoEdge();
-				LogEvent(risingIoEdge, std::string("Rising I/O edge found"));
-				DumpLines();
-
-				// We can use the first up/down dip to measure the baud rate.
-				U64 defaultEtu = decoder->CountClkCyclesToPosition(risingIoEdge);
-				LogEvent(fallingIoEdge, std::string("Found the start bit, initial ETU: ") + Convert::ToDec(defaultEtu) + std::string(" clocks..."));
-
-				// default ETU shoud be 372 
-				if (!IsValidETU(defaultEtu))
-				{
-					LogEvent(fallingIoEdge, std::string("This is not a valid start bit: ") + Convert::ToDec(defaultEtu) + std::string(" clocks..."));
-					session.reset();
-					continue;
-				}
-
-				// sync lines at the I/O rising edge
-				DumpLines();
-				decoder->Sync(risingIoEdge);
-
-
-				session = Iso7816Session::factory(mResults, defaultEtu, mSettings->mIoChannel.mChannelIndex, mSettings->mResetChannel.mChannelIndex);
-
-				AddMarker(fallingIoEdge, AnalyzerResults::DownArrow, mSettings->mIoChannel);
-				AddMarker(fallingIoEdge + ((risingIoEdge - fallingIoEdge) / 2), AnalyzerResults::Start, mSettings->mIoChannel);
-				AddMarker(risingIoEdge, AnalyzerResults::UpArrow, mSettings->mIoChannel);				
-				break;
-			}
-
-			// decode TS byte
-			unsigned char data = DecodeByte(decoder, session, true);
-
-			U64 endOfByte = decoder->GetIoPosition();
-			decoder->Sync(endOfByte);
-			session->PushByte(static_cast<unsigned char>(data & 0xFF), fallingIoEdge, endOfByte);
-
-			// now we keep waiting for the next 'down'; start bit
-			// and then read our 10 bits, etc, etc.
-			for (;;)
-			{
-				try
-				{
-					SeekForNextStartBit(decoder, session);
-					U64 startPos = decoder->GetIoPosition();
-					unsigned char bt = DecodeByte(decoder, session);
-
-					session->PushByte(bt, startPos, decoder->GetIoPosition());
-				}
-				catch (OutOfSyncException& ex)
-				{
-					AddMarker(ex.getPosition(), AnalyzerResults::ErrorDot, mSettings->mIoChannel);
-					LogEvent(ex.getPosition(), std::string("Out of sync with start bit."));
-					continue;
-				}
-				catch (ParityException& ex)
-				{
-					AddMarker(ex.getPosition(), AnalyzerResults::ErrorDot, mSettings->mIoChannel);
-					LogEvent(ex.getPosition(), std::string("Parity error"));
-					break;
-				}
-				catch (ErrorSignalException& ex)
-				{
-					LogEvent(ex.getPosition(), std::string("Stop bit not high."));
-					AddMarker(ex.getPosition(), AnalyzerResults::ErrorDot, mSettings->mIoChannel);
-					break;
-				}
-			}
-		}
-		catch (ResetException& ex)
-		{
-			LogEvent(ex.getPosition(), std::string("Found RESET line change"));
-		}
-		catch (std::exception& ex2)
-		{
-			LogEvent(0, ex2.what());
-		}
-	}
+	// the SDK gives a single cursor per channel, resets are decoded one after another
+	ChannelSource::ptr clk = mClk ? SaleaeChannelSource::factory(mClk) : ChannelSource::ptr();
+	Iso7816BitDecoder::ptr decoder = Iso7816BitDecoder::factory(SaleaeChannelSource::factory(mIo), SaleaeChannelSource::factory(mReset), SaleaeChannelSource::factory(mVcc), clk);
+	Iso7816Engine::ptr engine = Iso7816Engine::factory(decoder, mResults, GetEngineConfig());
+	engine->Run();
 }
 
-void iso7816Analyzer::SeekForNextStartBit(Iso7816BitDecoder::ptr decoder, Iso7816Session::ptr session)
+Iso7816Engine::Config iso7816Analyzer::GetEngineConfig()
 {
-	// falling edge -- beginning of the start bit
-	U64 fallingIoEdge = decoder->SeekForIoFallingEdge();
-	decoder->Sync(fallingIoEdge);
-	AddMarker(fallingIoEdge, AnalyzerResults::DownArrow, mSettings->mIoChannel);
-	U64 endOfStartBit = decoder->AdvanceClkCycles(session->GetEtu());
-	AddMarker(fallingIoEdge + ((endOfStartBit - fallingIoEdge) / 2), AnalyzerResults::Start, mSettings->mIoChannel);
-	AddMarker(endOfStartBit, AnalyzerResults::UpArrow, mSettings->mIoChannel);
-	LogEvent(fallingIoEdge, std::string("Found a new start bit"));
-	decoder->Sync(endOfStartBit);
+	Iso7816Engine::Config config;
+	config.ioChannelIndex = mSettings->mIoChannel.mChannelIndex;
+	config.resetChannelIndex = mSettings->mResetChannel.mChannelIndex;
+	config.sampleRate = GetSampleRate();
+	config.clkFrequency = mSettings->mClkFrequency;
+	config.etu = 0;
+	return config;
 }
 
-
-unsigned char iso7816Analyzer::DecodeByte(Iso7816BitDecoder::ptr decoder, Iso7816Session::ptr session, bool initialTs)
-{
-	// advance to the middle of first bit
-	U64 pos = decoder->AdvanceClkCycles(session->GetEtu() / 2);
-	LogEvent(pos, std::string("Mooving to the middle of first bit"));
-	decoder->Sync(pos);
-
-	unsigned char data = 0;
-	for (int i = 0; i <= 7; i++) {
-		U8 bit = decoder->GetIoState() ? 1 : 0;
-		AddMarker(pos, bit ? AnalyzerResults::One : AnalyzerResults::Zero, mSettings->mIoChannel);
-		LogEvent(decoder->GetIoPosition(), std::string("Found bit: ") + Convert::ToDec(bit ? 1 : 0));
-
-		// next bit
-		pos = decoder->AdvanceClkCycles(session->GetEtu());
-		decoder->Sync(pos);
-		LogEvent(pos, std::string("Advanced to the next bit"));
-
-		data = (data << 1) | bit;
-	};
-
-	// now we are right on parity bit
-	bool p = decoder->GetIoState() == BitState::BIT_HIGH ? true : false;
-
-	LogEvent(pos, std::string("Before parity check..."));
-	LogEvent(pos, std::string("Data: ") + Convert::ToHex(data));
-	LogEvent(pos, std::string("Parity: ") + (p ? std::string("true") : std::string("false")));
-
-	bool expectedParity = initialTs ? initialTs : Util::Parity(data);
-	AddMarker(pos, expectedParity != p ? AnalyzerResults::ErrorX : AnalyzerResults::X, mSettings->mIoChannel);
-
-	// 7.3 Error signal and character repetition
-	/*	As shown in Figure 9, when character parity is incorrect, the receiver shall transmit an error signal on the
-		electrical circuit I/O. Then the receiver shall expect a repetition of the character.
-	*/
-	pos = decoder->AdvanceClkCycles(session->GetEtu());
-	decoder->Sync(pos);
-	if (mIo->GetBitState() != BIT_HIGH)
-	{
-		throw ErrorSignalException(mIo->GetSampleNumber());
-	};
-
-	mResults->AddMarker(pos, AnalyzerResults::Stop, mSettings->mIoChannel);
-	return static_cast<unsigned char>(data);
-}
-
-bool iso7816Analyzer::IsValidETU(U64 ea)
-{
-	return ea > DEF_ETU_MIN && ea < DEF_ETU_MAX;
-}
-
-void iso7816Analyzer::LogEvent(U64 position, const std::string& msg)
-{
-	Logging::Write(std::string("[") + Convert::ToDec(position) + std::string("] ") + msg);
-}
-
-void iso7816Analyzer::LogEvent(U64 position, const char* msg)
-{
-    Logging::Write(std::string("[") + Convert::ToDec(position) + std::string("] ") + std::string(msg));
-}
-
-void iso7816Analyzer::AddMarker(U64 position, AnalyzerResults::MarkerType mt, Channel& channel)
-{
-	mResults->AddMarker(position, mt, channel);
-	mResults->CommitResults();
-}
-
-void iso7816Analyzer::DumpLines()
-{
-	std::string msg =
-		std::string("I/O: ") + Convert::ToDec(mIo->GetSampleNumber()) + std::string("(") + (mIo->GetBitState() == BIT_HIGH ? "1" : "0") + std::string("), ") +
-		std::string("RST: ") + Convert::ToDec(mReset->GetSampleNumber()) + std::string("(") + (mReset->GetBitState() == BIT_HIGH ? "1" : "0") + std::string("), ") +
-		std::string("CLK: ") + Convert::ToDec(mClk->GetSampleNumber()) + std::string("(") + (mClk->GetBitState() == BIT_HIGH ? "1" : "0") + std::string("), ") +
-		std::string("Vcc: ") + Convert::ToDec(mVcc->GetSampleNumber()) + std::string("(") + (mVcc->GetBitState() == BIT_HIGH ? "1" : "0") + std::string(")");
-    
-	LogEvent(mIo->GetSampleNumber(), msg);
-}
-
-
 bool iso7816Analyzer::NeedsRerun()
 {
 	return false;
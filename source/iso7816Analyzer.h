@@ -26,6 +26,8 @@
 #include "ProtocolFrames.h"
 #include "Iso7816Session.h"
 #include "Iso7816BitDecoder.h"
+#include "Iso7816Engine.h"
+#include "TraceBuffer.h"
 
 typedef enum {
 	DIRECT	= 0x02,
@@ -54,18 +56,13 @@ public:
 
 private:
 	virtual void _WorkerThread();
-	void SeekForNextStartBit(Iso7816BitDecoder::ptr decoder, Iso7816Session::ptr session);
-	unsigned char DecodeByte(Iso7816BitDecoder::ptr decoder, Iso7816Session::ptr session, bool initialTs = false);
-	bool IsValidETU(U64 ea);
-
-	void LogEvent(U64 position, const std::string& msg);
-    void LogEvent(U64 position, const char* msg);
-	void AddMarker(U64 position, AnalyzerResults::MarkerType mt, Channel& channel);
-	void DumpLines();
+	Iso7816Engine::Config GetEngineConfig();
+	void SaveTrace();
 
 private: //vars
 	std::unique_ptr<iso7816AnalyzerSettings> mSettings;
 	iso7816AnalyzerResults::ptr mResults;
+	TraceBuffer::ptr mTrace;
 
 	bool ppsFound;
 	bool apduStarted;
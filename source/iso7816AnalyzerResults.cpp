@@ -11,7 +11,6 @@
 #define LOGIC2
 #include <iostream>
 #include <fstream>
-#include <algorithm>
 #include <AnalyzerHelpers.h>
 #include "iso7816AnalyzerResults.h"
 #include "iso7816Analyzer.h"
@@ -19,6 +18,8 @@
 
 iso7816AnalyzerResults::iso7816AnalyzerResults( iso7816Analyzer* analyzer, iso7816AnalyzerSettings* settings )
 :	AnalyzerResults(),
+	_store( FrameStore::factory() ),
+	_cache( ResultStringCache::factory() ),
 	mSettings( settings ),
 	mAnalyzer( analyzer )
 {
@@ -28,17 +29,33 @@ iso7816AnalyzerResults::~iso7816AnalyzerResults()
 {
 }
 
-void iso7816AnalyzerResults::AddProtocolFrame(ProtocolFrame::ptr frame, const char* str)
+void iso7816AnalyzerResults::AddMarker(u64 pos, AnalyzerResults::MarkerType mt, Line line)
 {
-	_frames.push_back(frame);
+	AddMarker(pos, mt, line == RESET_LINE ? mSettings->mResetChannel : mSettings->mIoChannel);
+}
+
+void iso7816AnalyzerResults::Commit()
+{
+	CommitResults();
+}
+
+void iso7816AnalyzerResults::AddProtocolFrame(ProtocolFrame::ptr frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(_storeMutex);
+		frame->mData1 = frame->StoreIn(*_store);
+	}
 	AddFrame(*(frame.get()));
+
 	// New FrameV2 code.
 	FrameV2 frame_v2;
-// you can add any number of key value pairs. Each will get it's own column in the data table.
-	frame_v2.AddString( "t1", str );
-// This actually saves your new FrameV2. In this example, we just copy the same start and end sample number from Frame V1 above.
-// The second parameter is the frame "type". Any string is allowed.
-	AddFrameV2( frame_v2, "t1", frame.get()->mStartingSampleInclusive, frame.get()->mEndingSampleInclusive );
+	// every field gets its own column in the data table
+	const char* type = frame->GetFrameV2(frame_v2);
+	if (type != nullptr)
+	{
+		// the second parameter is the frame "type", any string is allowed
+		AddFrameV2( frame_v2, type, frame.get()->mStartingSampleInclusive, frame.get()->mEndingSampleInclusive );
+	}
 
 
 	CommitResults();
@@ -49,12 +66,16 @@ void iso7816AnalyzerResults::GenerateBubbleText(U64 frame_index, Channel& channe
 {
 	ClearResultStrings();
 
-	Frame frame = GetFrame(frame_index);
-	ProtocolFrame::ptr _frame = FindProtocolFrame(frame.mData1);
-	if (_frame)
+	std::lock_guard<std::mutex> lock(_storeMutex);
+	const ResultStringCache::Strings* strings = _cache->Find(frame_index, channel.mChannelIndex, display_base);
+	if (strings == nullptr)
 	{
-		_frame->RenderBubbleText(this, channel, display_base);
+		Frame frame = GetFrame(frame_index);
+		if (!IsStored(frame.mData1)) return;
+		_store->RenderBubbleText(static_cast<std::size_t>(frame.mData1), channel.mChannelIndex, display_base, _rendered);
+		strings = &_cache->Insert(frame_index, channel.mChannelIndex, display_base, _rendered);
 	}
+	AddResultStrings(*strings);
 }
 
 void iso7816AnalyzerResults::GenerateExportFile( const char* file, DisplayBase display_base, U32 export_type_user_id )
@@ -70,14 +91,17 @@ void iso7816AnalyzerResults::GenerateExportFile( const char* file, DisplayBase d
 	for( U32 i=0; i < num_frames; i++ )
 	{
 		Frame frame = GetFrame( i );
-		
+		std::string text;
+		{
+			std::lock_guard<std::mutex> lock(_storeMutex);
+			if (!IsStored(frame.mData1)) continue;
+			text = _store->ToString(static_cast<std::size_t>(frame.mData1));
+		}
+
 		char time_str[128];
 		AnalyzerHelpers::GetTimeString( frame.mStartingSampleInclusive, trigger_sample, sample_rate, time_str, 128 );
 
-		char number_str[128];
-		AnalyzerHelpers::GetNumberString( frame.mData1, display_base, 8, number_str, 128 );
-
-		file_stream << time_str << "," << number_str << std::endl;
+		file_stream << time_str << "," << text << std::endl;
 
 		if( UpdateExportProgressAndCheckForCancel( i, num_frames ) == true )
 		{
@@ -91,12 +115,18 @@ void iso7816AnalyzerResults::GenerateExportFile( const char* file, DisplayBase d
 
 void iso7816AnalyzerResults::GenerateFrameTabularText( U64 frame_index, DisplayBase display_base )
 {
-	Frame frame = GetFrame( frame_index );
 	ClearResultStrings();
 
-	char number_str[128];
-	AnalyzerHelpers::GetNumberString( frame.mData1, display_base, 8, number_str, 128 );
-	AddResultString( number_str );
+	std::lock_guard<std::mutex> lock(_storeMutex);
+	const ResultStringCache::Strings* strings = _cache->Find(frame_index, ResultStringCache::NO_CHANNEL, display_base);
+	if (strings == nullptr)
+	{
+		Frame frame = GetFrame( frame_index );
+		if (!IsStored(frame.mData1)) return;
+		_rendered.assign(1, _store->ToString(static_cast<std::size_t>(frame.mData1)));
+		strings = &_cache->Insert(frame_index, ResultStringCache::NO_CHANNEL, display_base, _rendered);
+	}
+	AddResultStrings(*strings);
 }
 
 void iso7816AnalyzerResults::GeneratePacketTabularText( U64 packet_id, DisplayBase display_base )
@@ -111,8 +141,15 @@ void iso7816AnalyzerResults::GenerateTransactionTabularText( U64 transaction_id,
 	AddResultString( "not supported" );
 }
 
-ProtocolFrame::ptr iso7816AnalyzerResults::FindProtocolFrame(U64 mData1)
+bool iso7816AnalyzerResults::IsStored(U64 mData1)
 {
-	auto it = std::find_if(_frames.begin(), _frames.end(), [=](ProtocolFrame::ptr i) {return i->mData1 == mData1; });
-	return (it == _frames.end()) ? ProtocolFrame::ptr() : (*it);
+	return mData1 < _store->GetCount();
+}
+
+void iso7816AnalyzerResults::AddResultStrings(const ResultStringCache::Strings& strings)
+{
+	for (const std::string& str : strings)
+	{
+		AddResultString(str.c_str());
+	}
 }
@@ -12,13 +12,17 @@
 #ifndef ISO7816_ANALYZER_RESULTS
 #define ISO7816_ANALYZER_RESULTS
 
+#include <mutex>
 #include <AnalyzerResults.h>
+#include "FrameStore.h"
+#include "ResultStringCache.h"
 #include "ProtocolFrames.h"
+#include "Iso7816Output.h"
 
 class iso7816Analyzer;
 class iso7816AnalyzerSettings;
 
-class iso7816AnalyzerResults : public AnalyzerResults
+class iso7816AnalyzerResults : public AnalyzerResults, public Iso7816Output
 {
 public:
 	typedef std::shared_ptr<iso7816AnalyzerResults> ptr;
@@ -27,7 +31,10 @@ public:
 	iso7816AnalyzerResults(iso7816Analyzer* analyzer, iso7816AnalyzerSettings* settings);
 	virtual ~iso7816AnalyzerResults();
 
-	void AddProtocolFrame(ProtocolFrame::ptr frame);
+	using AnalyzerResults::AddMarker;
+	virtual void AddMarker(u64 pos, AnalyzerResults::MarkerType mt, Line line);
+	virtual void AddProtocolFrame(ProtocolFrame::ptr frame);
+	virtual void Commit();
 
 	virtual void GenerateBubbleText(U64 frame_index, Channel& channel, DisplayBase display_base);
 	virtual void GenerateExportFile(const char* file, DisplayBase display_base, U32 export_type_user_id);
@@ -37,10 +44,17 @@ public:
 	virtual void GenerateTransactionTabularText(U64 transaction_id, DisplayBase display_base);
 
 private:
-	ProtocolFrame::ptr FindProtocolFrame(U64 mData1);
+	// mData1 of the SDK frame is the index of the frame in the store
+	bool IsStored(U64 mData1);
+	void AddResultStrings(const ResultStringCache::Strings& strings);
 
 protected: //functions
-	std::vector<ProtocolFrame::ptr> _frames;
+	// added by the worker thread while Logic renders the ones already there
+	FrameStore::ptr _store;
+	std::mutex _storeMutex;
+	// rendered strings of the frames in view, guarded by the store mutex as well
+	ResultStringCache::ptr _cache;
+	ResultStringCache::Strings _rendered;
 
 protected:  //vars
 	iso7816AnalyzerSettings* mSettings;
@@ -16,27 +16,37 @@ iso7816AnalyzerSettings::iso7816AnalyzerSettings()
 :	mVccChannel( UNDEFINED_CHANNEL ),
 	mResetChannel( UNDEFINED_CHANNEL ),
 	mClkChannel( UNDEFINED_CHANNEL ),
-	mIoChannel( UNDEFINED_CHANNEL )
+	mIoChannel( UNDEFINED_CHANNEL ),
+	mClkFrequency( 0 )
 {
 	mVccChannelInterface.reset( new AnalyzerSettingInterfaceChannel() );
 	mClkChannelInterface.reset( new AnalyzerSettingInterfaceChannel() );
 	mResetChannelInterface.reset( new AnalyzerSettingInterfaceChannel() );
 	mIoChannelInterface.reset( new AnalyzerSettingInterfaceChannel() );
+	mClkFrequencyInterface.reset( new AnalyzerSettingInterfaceInteger() );
 
 	mVccChannelInterface->SetTitleAndTooltip( "VCC/C1", "C1" );
 	mResetChannelInterface->SetTitleAndTooltip( "RST/C2", "C2 - Reset" );
 	mClkChannelInterface->SetTitleAndTooltip( "CLK/C3", "C3 - SCL or CLK" );
 	mIoChannelInterface->SetTitleAndTooltip( "IO/C7", "C7 - SDA or IO" );
+	mClkFrequencyInterface->SetTitleAndTooltip( "CLK frequency (Hz)", "Card clock frequency used when CLK is not captured, 0 - measure ETU from the TS start bit" );
+
+	// without CLK the ETU is measured in samples
+	mClkChannelInterface->SetSelectionOfNoneIsAllowed( true );
+	mClkFrequencyInterface->SetMin( 0 );
+	mClkFrequencyInterface->SetMax( 100000000 );
 
 	mVccChannelInterface->SetChannel( mVccChannel );
 	mResetChannelInterface->SetChannel( mResetChannel );
 	mClkChannelInterface->SetChannel( mClkChannel );
 	mIoChannelInterface->SetChannel( mIoChannel );
+	mClkFrequencyInterface->SetInteger( mClkFrequency );
 
 	AddInterface( mVccChannelInterface.get() );
 	AddInterface( mResetChannelInterface.get() );
 	AddInterface( mClkChannelInterface.get() );
 	AddInterface( mIoChannelInterface.get() );
+	AddInterface( mClkFrequencyInterface.get() );
 
 	AddExportOption( 0, "Export as text/csv file" );
 	AddExportExtension( 0, "text", "txt" );
@@ -58,11 +68,12 @@ bool iso7816AnalyzerSettings::SetSettingsFromInterfaces()
 	mResetChannel = mResetChannelInterface->GetChannel();
 	mClkChannel = mClkChannelInterface->GetChannel();
 	mIoChannel = mIoChannelInterface->GetChannel();
+	mClkFrequency = mClkFrequencyInterface->GetInteger();
 
 	ClearChannels();
 	AddChannel( mVccChannel, "VCC", true );
 	AddChannel( mResetChannel, "RST", true );
-	AddChannel( mClkChannel, "SCL/CLK", true );
+	AddChannel( mClkChannel, "SCL/CLK", mClkChannel != UNDEFINED_CHANNEL );
 	AddChannel( mIoChannel, "SDA/IO", true );
 
 	return true;
@@ -74,6 +85,7 @@ void iso7816AnalyzerSettings::UpdateInterfacesFromSettings()
 	mResetChannelInterface->SetChannel( mResetChannel );
 	mClkChannelInterface->SetChannel( mClkChannel );
 	mIoChannelInterface->SetChannel( mIoChannel );
+	mClkFrequencyInterface->SetInteger( mClkFrequency );
 }
 
 void iso7816AnalyzerSettings::LoadSettings( const char* settings )
@@ -85,11 +97,16 @@ void iso7816AnalyzerSettings::LoadSettings( const char* settings )
 	text_archive >> mResetChannel;
 	text_archive >> mClkChannel;
 	text_archive >> mIoChannel;
+	// not available in settings saved by older versions
+	if ( !( text_archive >> mClkFrequency ) )
+	{
+		mClkFrequency = 0;
+	}
 
 	ClearChannels();
 	AddChannel( mVccChannel, "VCC", true);
 	AddChannel( mResetChannel, "RST", true);
-	AddChannel( mClkChannel, "SCL/CLK", true);
+	AddChannel( mClkChannel, "SCL/CLK", mClkChannel != UNDEFINED_CHANNEL);
 	AddChannel( mIoChannel, "SDA/IO", true);
 
 	UpdateInterfacesFromSettings();
@@ -103,6 +120,7 @@ const char* iso7816AnalyzerSettings::SaveSettings()
 	text_archive << mResetChannel;
 	text_archive << mClkChannel;
 	text_archive << mIoChannel;
+	text_archive << mClkFrequency;
 
 	return SetReturnString( text_archive.GetString() );
 }
@@ -27,12 +27,14 @@ public:
 	virtual const char* SaveSettings();
 
 	Channel mVccChannel, mResetChannel, mClkChannel, mIoChannel;
+	U32 mClkFrequency;
 
 protected:
 	std::auto_ptr< AnalyzerSettingInterfaceChannel >	mVccChannelInterface;
 	std::auto_ptr< AnalyzerSettingInterfaceChannel >	mResetChannelInterface;
 	std::auto_ptr< AnalyzerSettingInterfaceChannel >	mClkChannelInterface;
 	std::auto_ptr< AnalyzerSettingInterfaceChannel >	mIoChannelInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >	mClkFrequencyInterface;
 };
 
 #endif //ISO7816_ANALYZER_SETTINGS
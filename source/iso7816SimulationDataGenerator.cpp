@@ -13,7 +13,6 @@
 #include "iso7816AnalyzerSettings.h"
 
 #include <AnalyzerHelpers.h>
-#include <stdlib.h>
 #include <ctime>
 
 iso7816SimulationDataGenerator::iso7816SimulationDataGenerator()
@@ -28,46 +27,53 @@ void iso7816SimulationDataGenerator::Initialize( U32 simulation_sample_rate, iso
 {
 	mSimulationSampleRateHz = simulation_sample_rate;
 	mSettings = settings;
-    srand(rand() ^ static_cast<int>(time(NULL)));
 
-	mSerialSimulationData.SetInitialBitState( BIT_HIGH );
+	// endless T=1 sessions, a new capture every time
+	Iso7816Synthesiser::Config config;
+	config.seed = static_cast<U32>( time( NULL ) );
+	config.sampleRate = simulation_sample_rate;
+	if( mSettings->mClkFrequency != 0 )
+		config.clkFrequency = mSettings->mClkFrequency;
+	config.recordClk = mSettings->mClkChannel != UNDEFINED_CHANNEL;
+	config.sessions = 0;
+	mSynthesiser = Iso7816Synthesiser::factory( config );
+
+	Channel* channels[EdgeCapture::LINES] = { &mSettings->mVccChannel, &mSettings->mResetChannel, &mSettings->mClkChannel, &mSettings->mIoChannel };
+	for( int line = 0; line < EdgeCapture::LINES; line++ )
+	{
+		mSink.mChannels[line] = nullptr;
+		if( line == EdgeCapture::CLK_LINE && !mSynthesiser->IsClkRecorded() )
+			continue;
+		BitState initial = Iso7816Synthesiser::GetInitialState( static_cast<EdgeCapture::Line>( line ) );
+		mSink.mChannels[line] = mSimulationChannels.Add( *channels[line], simulation_sample_rate, initial );
+	}
 }
 
 U32 iso7816SimulationDataGenerator::GenerateSimulationData( U64 largest_sample_requested, U32 sample_rate, SimulationChannelDescriptor** simulation_channel )
 {
 	U64 adjusted_largest_sample_requested = AnalyzerHelpers::AdjustSimulationTargetSample( largest_sample_requested, sample_rate, mSimulationSampleRateHz );
 
-	while( mSerialSimulationData.GetCurrentSampleNumber() < adjusted_largest_sample_requested )
-	{
-        U32 samples_per_bit = 100; // mSimulationSampleRateHz / mSettings->mBitRate;
-        
-        U8 byte = rand() & 0xFF;
+	U64 reached = mSynthesiser->GenerateTo( adjusted_largest_sample_requested, mSink );
+	mSink.AdvanceTo( reached );
 
-        mSerialSimulationData.Advance( samples_per_bit * 20 );
-        
-        mSerialSimulationData.Transition();  //low-going edge for start bit
-        mSerialSimulationData.Advance( samples_per_bit );  //add start bit time
-        mSerialSimulationData.Transition();  // end of start bit.
-        mSerialSimulationData.Advance( samples_per_bit );  //add start bit time
-        
-        U8 mask = 0x1 << 7;
-        for( U32 i=0; i<8; i++ )
-        {
-            if( ( byte & mask ) != 0 )
-                mSerialSimulationData.TransitionIfNeeded( BIT_HIGH );
-            else
-                mSerialSimulationData.TransitionIfNeeded( BIT_LOW );
-            
-            mSerialSimulationData.Advance( samples_per_bit );
-            mask = mask >> 1;
-        }
-        
-        mSerialSimulationData.TransitionIfNeeded( BIT_HIGH ); //we need to end high
-        mSerialSimulationData.Advance( samples_per_bit );
-        
-	}
+	*simulation_channel = mSimulationChannels.GetArray();
+	return mSimulationChannels.GetCount();
+}
 
-	*simulation_channel = &mSerialSimulationData;
-	return 1;
+void iso7816SimulationDataGenerator::ChannelSink::AddEdge( EdgeCapture::Line line, U64 sample )
+{
+	SimulationChannelDescriptor* channel = mChannels[line];
+	channel->Advance( static_cast<U32>( sample - channel->GetCurrentSampleNumber() ) );
+	channel->Transition();
+}
+
+void iso7816SimulationDataGenerator::ChannelSink::AdvanceTo( U64 sample )
+{
+	for( int line = 0; line < EdgeCapture::LINES; line++ )
+	{
+		SimulationChannelDescriptor* channel = mChannels[line];
+		if( channel != nullptr && channel->GetCurrentSampleNumber() < sample )
+			channel->Advance( static_cast<U32>( sample - channel->GetCurrentSampleNumber() ) );
+	}
 }
 
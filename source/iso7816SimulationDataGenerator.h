@@ -14,6 +14,7 @@
 
 #include <SimulationChannelDescriptor.h>
 #include <string>
+#include "Iso7816Synthesiser.h"
 class iso7816AnalyzerSettings;
 
 class iso7816SimulationDataGenerator
@@ -26,11 +27,23 @@ public:
 	U32 GenerateSimulationData( U64 newest_sample_requested, U32 sample_rate, SimulationChannelDescriptor** simulation_channel );
 
 protected:
+	// edges of the synthesised sessions go straight into the channel descriptors
+	class ChannelSink : public Iso7816Synthesiser::Sink
+	{
+	public:
+		SimulationChannelDescriptor* mChannels[EdgeCapture::LINES];
+
+		virtual void AddEdge( EdgeCapture::Line line, U64 sample );
+		void AdvanceTo( U64 sample );
+	};
+
 	iso7816AnalyzerSettings* mSettings;
 	U32 mSimulationSampleRateHz;
 
 protected:
-	SimulationChannelDescriptor mSerialSimulationData;
+	Iso7816Synthesiser::ptr mSynthesiser;
+	SimulationChannelDescriptorGroup mSimulationChannels;
+	ChannelSink mSink;
 
 };
 #endif //ISO7816_SIMULATION_DATA_GENERATOR
\ No newline at end of file
@@ -0,0 +1,112 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+// Decodes a long synthetic T=1 session and reports the heap allocations of every decode phase,
+// per character and per frame. Fails when the transmission phase allocates more than its budget:
+//
+//   iso7816allocationtest [-exchanges n]
+//
+// The engine has to be built with ISO7816_ALLOCATION_ACCOUNTING, allocations are seen through
+// AllocationHooks.cpp.
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "AllocationCounter.h"
+#include "Iso7816BitDecoder.h"
+#include "Iso7816Engine.h"
+#include "Iso7816Output.h"
+#include "Iso7816Synthesiser.h"
+
+// allocations of the steady state T=1 transmission: bits, characters, blocks and their frames;
+// lower it as the per-byte path gets cheaper, never raise it to make a change pass
+static const double TRANSMISSION_ALLOCATIONS_PER_CHARACTER = 0.5;
+
+// frames are dropped as they come, only the decoder allocates
+class DiscardingOutput : public Iso7816Output
+{
+public:
+	virtual void AddMarker(u64 pos, AnalyzerResults::MarkerType mt, Line line)
+	{
+	}
+	virtual void AddProtocolFrame(ProtocolFrame::ptr frame)
+	{
+	}
+	virtual void Commit()
+	{
+	}
+};
+
+static double PerItem(U64 count, U64 items)
+{
+	return items != 0 ? static_cast<double>(count) / items : 0.0;
+}
+
+int main(int argc, char* argv[])
+{
+	Iso7816Synthesiser::Config synthesis;
+	synthesis.seed = 19;
+	synthesis.protocol = 1;
+	synthesis.ta1 = 0x13;
+	synthesis.sessions = 1;
+	synthesis.exchanges = 200;
+	synthesis.maxPayload = 250;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "-exchanges" && i + 1 < argc) synthesis.exchanges = static_cast<U32>(std::strtoul(argv[++i], nullptr, 10));
+		else
+		{
+			std::cerr << "usage: iso7816allocationtest [-exchanges n]" << std::endl;
+			return 2;
+		}
+	}
+
+	Iso7816Synthesiser::MemorySink sink;
+	sink.Generate(*Iso7816Synthesiser::factory(synthesis));
+
+	Iso7816Engine::Config config;
+	config.ioChannelIndex = EdgeCapture::IO_LINE;
+	config.resetChannelIndex = EdgeCapture::RST_LINE;
+	config.sampleRate = synthesis.sampleRate;
+	config.clkFrequency = 0;
+	config.etu = 0;
+
+	Iso7816BitDecoder::ptr decoder = Iso7816BitDecoder::factory(sink.OpenLine(EdgeCapture::IO_LINE), sink.OpenLine(EdgeCapture::RST_LINE),
+		sink.OpenLine(EdgeCapture::VCC_LINE), sink.OpenLine(EdgeCapture::CLK_LINE));
+	Iso7816Engine::ptr engine = Iso7816Engine::factory(decoder, Iso7816Output::ptr(new DiscardingOutput()), config);
+	AllocationCounter::ResetPhases();
+	engine->Run();
+
+	std::cout << "phase,allocations,bytes,characters,frames,allocations_per_character,bytes_per_character,allocations_per_frame" << std::endl;
+	for (int i = 0; i < AllocationCounter::PHASES; i++)
+	{
+		AllocationCounter::Phase phase = static_cast<AllocationCounter::Phase>(i);
+		AllocationCounter::PhaseCounts counts = AllocationCounter::GetPhase(phase);
+		std::cout << AllocationCounter::GetPhaseName(phase) << ',' << counts.allocations << ',' << counts.bytes << ',' << counts.characters << ','
+			<< counts.frames << ',' << PerItem(counts.allocations, counts.characters) << ',' << PerItem(counts.bytes, counts.characters) << ','
+			<< PerItem(counts.allocations, counts.frames) << std::endl;
+	}
+
+	AllocationCounter::PhaseCounts transmission = AllocationCounter::GetPhase(AllocationCounter::TRANSMISSION);
+	if (transmission.characters == 0)
+	{
+		std::cerr << "FAILED: no T=1 characters decoded, built without ISO7816_ALLOCATION_ACCOUNTING?" << std::endl;
+		return 1;
+	}
+	double perCharacter = PerItem(transmission.allocations, transmission.characters);
+	if (perCharacter > TRANSMISSION_ALLOCATIONS_PER_CHARACTER)
+	{
+		std::cerr << "FAILED: " << perCharacter << " allocations per T=1 character, the budget is " << TRANSMISSION_ALLOCATIONS_PER_CHARACTER << std::endl;
+		return 1;
+	}
+	std::cerr << "passed: " << perCharacter << " allocations per T=1 character, the budget is " << TRANSMISSION_ALLOCATIONS_PER_CHARACTER << std::endl;
+	return 0;
+}
@@ -0,0 +1,314 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+// Decodes offline captures without Logic, one capture per worker thread:
+//
+//   iso7816batch [-j threads] [-p threads] [-o directory] [-s stats.csv] [-c clk Hz] [-t] capture...
+//
+// Frames of every capture go to <capture>.frames.csv (in the -o directory when given),
+// one line per capture with the decoding time goes to the stats file or to stdout.
+// With -t the binary trace of the decoding goes to <capture>.trace, iso7816tracedump reads it.
+// With -p the sessions of a capture are decoded on that many threads as well, split on RST edges;
+// the trace then holds only what the capture thread did.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "EdgeCapture.h"
+#include "Iso7816BitDecoder.h"
+#include "Iso7816Engine.h"
+#include "Iso7816Output.h"
+#include "Iso7816ParallelDecoder.h"
+#include "TraceBuffer.h"
+
+// Writes the frames as CSV: start, end, line, text
+class FrameFileOutput : public Iso7816Output
+{
+public:
+	typedef std::shared_ptr<FrameFileOutput> ptr;
+	static FrameFileOutput::ptr factory(const std::string& path, const Iso7816Engine::Config& config)
+	{
+		FrameFileOutput::ptr ret(new FrameFileOutput(path, config));
+		return ret;
+	}
+
+	bool IsOpen() const
+	{
+		return _file.is_open();
+	}
+	U64 GetFrames() const
+	{
+		return _frames;
+	}
+	U64 GetMarkers() const
+	{
+		return _markers;
+	}
+
+	virtual void AddMarker(u64 pos, AnalyzerResults::MarkerType mt, Line line)
+	{
+		_markers++;
+	}
+	virtual void AddProtocolFrame(ProtocolFrame::ptr frame)
+	{
+		_frames++;
+		const char* line = frame->GetChannelIndex() == _config.resetChannelIndex ? "RST" : "IO";
+		std::string text = frame->ToString();
+		std::replace(text.begin(), text.end(), '"', '\'');
+		_file << frame->mStartingSampleInclusive << ',' << frame->mEndingSampleInclusive << ',' << line << ",\"" << text << "\"\n";
+	}
+	virtual void Commit()
+	{
+	}
+
+protected:
+	FrameFileOutput(const std::string& path, const Iso7816Engine::Config& config)
+		: _buffer(1 << 20)
+	{
+		_config = config;
+		_file.rdbuf()->pubsetbuf(&_buffer[0], _buffer.size());
+		_file.open(path.c_str(), std::ios::out | std::ios::trunc);
+		if (_file.is_open())
+		{
+			_file << "start,end,line,text\n";
+		}
+	}
+
+	Iso7816Engine::Config _config;
+	std::vector<char> _buffer;
+	std::ofstream _file;
+	U64 _frames = 0;
+	U64 _markers = 0;
+};
+
+struct Options
+{
+	unsigned int threads = 0;		// 0 for one per core
+	unsigned int segmentThreads = 0;	// threads on the sessions of a capture, 0 to decode it in one go
+	std::string outputDirectory;	// empty to write next to the capture
+	std::string statsPath;			// empty for stdout
+	U32 clkFrequency = 0;
+	bool trace = false;
+	std::vector<std::string> captures;
+};
+
+struct CaptureStats
+{
+	std::string status;
+	U64 samples = 0;
+	U64 edges = 0;
+	U64 frames = 0;
+	U64 markers = 0;
+	double seconds = 0.0;
+};
+
+static std::string GetOutputPath(const Options& options, const std::string& capture, const char* extension)
+{
+	if (options.outputDirectory.empty())
+	{
+		return capture + extension;
+	}
+	std::size_t slash = capture.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? capture : capture.substr(slash + 1);
+	return options.outputDirectory + "/" + name + extension;
+}
+
+static CaptureStats DecodeCapture(const Options& options, const std::string& capture)
+{
+	CaptureStats stats;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	EdgeCaptureFile::ptr file = EdgeCaptureFile::factory(capture);
+	if (!file)
+	{
+		stats.status = "unreadable";
+		return stats;
+	}
+	if (!file->HasLine(EdgeCapture::IO_LINE) || !file->HasLine(EdgeCapture::RST_LINE) || !file->HasLine(EdgeCapture::VCC_LINE))
+	{
+		stats.status = "missing lines";
+		return stats;
+	}
+
+	Iso7816Engine::Config config;
+	config.ioChannelIndex = EdgeCapture::IO_LINE;
+	config.resetChannelIndex = EdgeCapture::RST_LINE;
+	config.sampleRate = file->GetSampleRate();
+	config.clkFrequency = options.clkFrequency;
+	config.etu = 0;
+
+	FrameFileOutput::ptr output = FrameFileOutput::factory(GetOutputPath(options, capture, ".frames.csv"), config);
+	if (!output->IsOpen())
+	{
+		stats.status = "cannot write frames";
+		return stats;
+	}
+
+	TraceBuffer::ptr trace = options.trace ? TraceBuffer::factory() : TraceBuffer::ptr();
+	TraceBuffer::Scope traceScope(trace);
+	try
+	{
+		if (options.segmentThreads > 0)
+		{
+			Iso7816ParallelDecoder::ChannelProvider provider = [file](Iso7816ParallelDecoder::Channels& channels)
+			{
+				channels.io = file->OpenLine(EdgeCapture::IO_LINE);
+				channels.reset = file->OpenLine(EdgeCapture::RST_LINE);
+				channels.vcc = file->OpenLine(EdgeCapture::VCC_LINE);
+				channels.clk = file->OpenLine(EdgeCapture::CLK_LINE);
+				return true;
+			};
+			bool decoded = Iso7816ParallelDecoder::factory(provider, output, config, options.segmentThreads)->Run();
+			stats.status = decoded ? "ok" : "cannot open lines";
+		}
+		else
+		{
+			Iso7816BitDecoder::ptr decoder = Iso7816BitDecoder::factory(file->OpenLine(EdgeCapture::IO_LINE), file->OpenLine(EdgeCapture::RST_LINE),
+				file->OpenLine(EdgeCapture::VCC_LINE), file->OpenLine(EdgeCapture::CLK_LINE));
+			Iso7816Engine::factory(decoder, output, config)->Run();
+			stats.status = "ok";
+		}
+	}
+	catch (std::exception& e)
+	{
+		stats.status = std::string("error: ") + e.what();
+	}
+
+	stats.samples = file->GetLastSample();
+	for (int line = 0; line < EdgeCapture::LINES; line++)
+	{
+		stats.edges += file->GetEdgeCount(static_cast<EdgeCapture::Line>(line));
+	}
+	stats.frames = output->GetFrames();
+	stats.markers = output->GetMarkers();
+	output.reset();		// flushes the frames before the clock stops
+	if (trace && !TraceBuffer::WriteSnapshot(GetOutputPath(options, capture, ".trace"), trace->Snapshot()))
+	{
+		stats.status = "cannot write trace";
+	}
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+static bool ParseOptions(int argc, char* argv[], Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "-j" && hasValue)
+		{
+			options.threads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "-p" && hasValue)
+		{
+			options.segmentThreads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "-o" && hasValue)
+		{
+			options.outputDirectory = argv[++i];
+		}
+		else if (arg == "-s" && hasValue)
+		{
+			options.statsPath = argv[++i];
+		}
+		else if (arg == "-c" && hasValue)
+		{
+			options.clkFrequency = static_cast<U32>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "-t")
+		{
+			options.trace = true;
+		}
+		else if (!arg.empty() && arg[0] == '-')
+		{
+			return false;
+		}
+		else
+		{
+			options.captures.push_back(arg);
+		}
+	}
+	return !options.captures.empty();
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		std::cerr << "usage: iso7816batch [-j threads] [-p threads] [-o directory] [-s stats.csv] [-c clk Hz] [-t] capture..." << std::endl;
+		return 2;
+	}
+
+	unsigned int threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	threads = std::min(threads, static_cast<unsigned int>(options.captures.size()));
+
+	// captures are taken in turn, the slowest one does not hold up the others
+	std::vector<CaptureStats> stats(options.captures.size());
+	std::atomic<std::size_t> next(0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < threads; t++)
+	{
+		workers.push_back(std::thread([&]()
+		{
+			for (std::size_t i = next++; i < options.captures.size(); i = next++)
+			{
+				stats[i] = DecodeCapture(options, options.captures[i]);
+			}
+		}));
+	}
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::ofstream statsFile;
+	if (!options.statsPath.empty())
+	{
+		statsFile.open(options.statsPath.c_str(), std::ios::out | std::ios::trunc);
+		if (!statsFile.is_open())
+		{
+			std::cerr << "cannot write " << options.statsPath << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = statsFile.is_open() ? static_cast<std::ostream&>(statsFile) : std::cout;
+
+	int failed = 0;
+	U64 samples = 0;
+	out << "capture,status,samples,edges,frames,markers,seconds,samples_per_second\n";
+	for (std::size_t i = 0; i < options.captures.size(); i++)
+	{
+		const CaptureStats& s = stats[i];
+		if (s.status != "ok") failed++;
+		samples += s.samples;
+		double rate = s.seconds > 0.0 ? s.samples / s.seconds : 0.0;
+		out << options.captures[i] << ",\"" << s.status << "\"," << s.samples << ',' << s.edges << ',' << s.frames << ','
+			<< s.markers << ',' << s.seconds << ',' << static_cast<U64>(rate) << '\n';
+	}
+	out.flush();
+
+	std::cerr << options.captures.size() << " captures, " << threads << " threads, " << seconds << " s, "
+		<< static_cast<U64>(seconds > 0.0 ? samples / seconds : 0.0) << " samples/s, " << failed << " failed" << std::endl;
+	return failed == 0 ? 0 : 1;
+}
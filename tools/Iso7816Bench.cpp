@@ -0,0 +1,243 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+// Measures how fast the engine decodes synthetic captures, the same way the analyzer does in Logic.
+// Every combination of the listed values is one case, a case is decoded -repeat times and the fastest
+// run is reported as one CSV line:
+//
+//   iso7816bench [-label name] [-rate Hz,...] [-clk Hz,...] [-ta1 hh,...] [-t 0|1,...] [-errors ppm,...]
+//                [-sessions n] [-exchanges n] [-repeat n] [-seed n] [-p threads] [-o results.csv]
+//
+// -ta1 gives Fi/Di negotiated by PPS, -errors the characters in a million with a wrong parity bit.
+// -p decodes the sessions on that many threads, split on RST edges, instead of the serial engine.
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ISO7816Pps.hpp"
+#include "Iso7816BitDecoder.h"
+#include "Iso7816Engine.h"
+#include "Iso7816Output.h"
+#include "Iso7816ParallelDecoder.h"
+#include "Iso7816Synthesiser.h"
+
+// Counts the characters by their stop markers, T=1 ones are not reported one by one, and frames on RST
+class CountingOutput : public Iso7816Output
+{
+public:
+	typedef std::shared_ptr<CountingOutput> ptr;
+
+	CountingOutput(const Iso7816Engine::Config& config)
+		: _config(config)
+	{
+	}
+
+	virtual void AddMarker(u64 pos, AnalyzerResults::MarkerType mt, Line line)
+	{
+		if (mt == AnalyzerResults::Stop && line == IO_LINE)
+		{
+			characters++;
+		}
+	}
+	virtual void AddProtocolFrame(ProtocolFrame::ptr frame)
+	{
+		if (frame->GetChannelIndex() == _config.resetChannelIndex)
+		{
+			frames++;
+		}
+	}
+	virtual void Commit()
+	{
+	}
+
+	U64 characters = 0;
+	U64 frames = 0;
+
+protected:
+	Iso7816Engine::Config _config;
+};
+
+struct Options
+{
+	std::string label = "-";
+	std::vector<U64> rates = { 24000000 };
+	std::vector<U64> clks = { 3571200 };
+	std::vector<U64> ta1s = { 0x11, 0x13, 0x96 };
+	std::vector<U64> protocols = { 0, 1 };
+	std::vector<U64> errors = { 0, 1000 };
+	U32 sessions = 4;
+	U32 exchanges = 64;
+	U32 repeat = 3;
+	U32 seed = 1;
+	U32 threads = 0;			// 0 for the serial engine
+	std::string outputPath;		// empty for stdout
+};
+
+static bool ParseList(const char* value, int base, std::vector<U64>& list)
+{
+	list.clear();
+	std::stringstream ss(value);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		if (item.empty()) return false;
+		list.push_back(std::strtoull(item.c_str(), nullptr, base));
+	}
+	return !list.empty();
+}
+
+static bool ParseOptions(int argc, char* argv[], Options& options)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		const char* value = argv[i + 1];
+		bool ok = true;
+		if (arg == "-label") options.label = value;
+		else if (arg == "-rate") ok = ParseList(value, 10, options.rates);
+		else if (arg == "-clk") ok = ParseList(value, 10, options.clks);
+		else if (arg == "-ta1") ok = ParseList(value, 16, options.ta1s);
+		else if (arg == "-t") ok = ParseList(value, 10, options.protocols);
+		else if (arg == "-errors") ok = ParseList(value, 10, options.errors);
+		else if (arg == "-sessions") options.sessions = static_cast<U32>(std::strtoul(value, nullptr, 10));
+		else if (arg == "-exchanges") options.exchanges = static_cast<U32>(std::strtoul(value, nullptr, 10));
+		else if (arg == "-repeat") options.repeat = static_cast<U32>(std::strtoul(value, nullptr, 10));
+		else if (arg == "-seed") options.seed = static_cast<U32>(std::strtoul(value, nullptr, 10));
+		else if (arg == "-p") options.threads = static_cast<U32>(std::strtoul(value, nullptr, 10));
+		else if (arg == "-o") options.outputPath = value;
+		else return false;
+		if (!ok) return false;
+	}
+	return argc % 2 == 1 && options.sessions != 0 && options.repeat != 0;
+}
+
+struct Result
+{
+	U64 samples = 0;
+	U64 edges = 0;
+	U64 characters = 0;
+	U64 frames = 0;
+	double seconds = 0.0;
+};
+
+static Result RunCase(const Options& options, const Iso7816Synthesiser::Config& synthesis)
+{
+	// the edges are kept in memory, the decoding is timed without the file system
+	Iso7816Synthesiser::MemorySink sink;
+	Result result;
+	result.samples = sink.Generate(*Iso7816Synthesiser::factory(synthesis));
+	for (int line = 0; line < EdgeCapture::LINES; line++)
+	{
+		result.edges += sink.GetEdgeCount(static_cast<EdgeCapture::Line>(line));
+	}
+
+	Iso7816Engine::Config config;
+	config.ioChannelIndex = EdgeCapture::IO_LINE;
+	config.resetChannelIndex = EdgeCapture::RST_LINE;
+	config.sampleRate = synthesis.sampleRate;
+	config.clkFrequency = 0;
+	config.etu = 0;
+
+	// every call gives cursors of their own over the same edges
+	Iso7816ParallelDecoder::ChannelProvider provider = [&sink](Iso7816ParallelDecoder::Channels& channels)
+	{
+		channels.io = sink.OpenLine(EdgeCapture::IO_LINE);
+		channels.reset = sink.OpenLine(EdgeCapture::RST_LINE);
+		channels.vcc = sink.OpenLine(EdgeCapture::VCC_LINE);
+		channels.clk = sink.OpenLine(EdgeCapture::CLK_LINE);
+		return true;
+	};
+
+	for (U32 run = 0; run < options.repeat; run++)
+	{
+		CountingOutput::ptr output(new CountingOutput(config));
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (options.threads > 0)
+		{
+			Iso7816ParallelDecoder::factory(provider, output, config, options.threads)->Run();
+		}
+		else
+		{
+			Iso7816ParallelDecoder::Channels channels;
+			provider(channels);
+			Iso7816BitDecoder::ptr decoder = Iso7816BitDecoder::factory(channels.io, channels.reset, channels.vcc, channels.clk);
+			Iso7816Engine::factory(decoder, output, config)->Run();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (run == 0 || seconds < result.seconds)
+		{
+			result.seconds = seconds;
+		}
+		result.characters = output->characters;
+		result.frames = output->frames;
+	}
+	return result;
+}
+
+static U64 PerSecond(U64 count, double seconds)
+{
+	return seconds > 0.0 ? static_cast<U64>(count / seconds) : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		std::cerr << "usage: iso7816bench [-label name] [-rate Hz,...] [-clk Hz,...] [-ta1 hh,...] [-t 0|1,...] [-errors ppm,...]" << std::endl
+			<< "                    [-sessions n] [-exchanges n] [-repeat n] [-seed n] [-p threads] [-o results.csv]" << std::endl;
+		return 2;
+	}
+
+	std::ofstream file;
+	if (!options.outputPath.empty())
+	{
+		file.open(options.outputPath.c_str(), std::ios::out | std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cerr << "cannot write " << options.outputPath << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = file.is_open() ? static_cast<std::ostream&>(file) : std::cout;
+
+	out << "label,sample_rate,clk,ta1,etu,protocol,parity_errors_ppm,samples,edges,characters,frames,seconds,"
+		"samples_per_second,characters_per_second,frames_per_second\n";
+	for (U64 rate : options.rates)
+	for (U64 clk : options.clks)
+	for (U64 ta1 : options.ta1s)
+	for (U64 protocol : options.protocols)
+	for (U64 errors : options.errors)
+	{
+		Iso7816Synthesiser::Config synthesis;
+		synthesis.seed = options.seed;
+		synthesis.sampleRate = rate;
+		synthesis.clkFrequency = static_cast<U32>(clk);
+		synthesis.ta1 = static_cast<U8>(ta1);
+		synthesis.protocol = static_cast<U32>(protocol);
+		synthesis.parityErrors = static_cast<U32>(errors);
+		synthesis.sessions = options.sessions;
+		synthesis.exchanges = options.exchanges;
+
+		Result result = RunCase(options, synthesis);
+		int etu = ISO7816Pps::CalculateETU((ta1 >> 4) & 0x0f, ta1 & 0x0f);
+		out << options.label << ',' << rate << ',' << clk << ',' << Convert::ToHex(static_cast<unsigned char>(ta1)) << ',' << etu << ','
+			<< protocol << ',' << errors << ',' << result.samples << ',' << result.edges << ',' << result.characters << ','
+			<< result.frames << ',' << result.seconds << ',' << PerSecond(result.samples, result.seconds) << ','
+			<< PerSecond(result.characters, result.seconds) << ',' << PerSecond(result.frames, result.seconds) << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,161 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+// Decodes synthetic captures serially and on the parallel decoder, and fails when the frames or
+// markers differ in any way. Besides captures of many sessions there is a long single session, and one
+// joined after the reset, where the character framing is found on I/O:
+//
+//   iso7816paralleltest [-sessions n] [-threads n]
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Iso7816BitDecoder.h"
+#include "Iso7816Engine.h"
+#include "Iso7816Output.h"
+#include "Iso7816ParallelDecoder.h"
+#include "Iso7816Synthesiser.h"
+
+// every marker and frame as one line of text, in the order they come
+class RecordingOutput : public Iso7816Output
+{
+public:
+	typedef std::shared_ptr<RecordingOutput> ptr;
+
+	virtual void AddMarker(u64 pos, AnalyzerResults::MarkerType mt, Line line)
+	{
+		std::stringstream ss;
+		ss << "marker " << pos << ' ' << mt << ' ' << line;
+		entries.push_back(ss.str());
+	}
+	virtual void AddProtocolFrame(ProtocolFrame::ptr frame)
+	{
+		std::stringstream ss;
+		ss << "frame " << frame->mStartingSampleInclusive << ' ' << frame->mEndingSampleInclusive << ' ' << frame->GetChannelIndex() << ' ' << frame->ToString();
+		entries.push_back(ss.str());
+	}
+	virtual void Commit()
+	{
+	}
+
+	std::vector<std::string> entries;
+};
+
+struct Case
+{
+	const char* name;
+	U32 protocol;
+	bool recordClk;
+	bool inverse;
+	U32 parityErrors;
+	U32 sessions;			// 0 for the number given on the command line
+	U32 exchanges;
+	double cut;				// part of the capture left out at the beginning
+};
+
+static bool RunCase(const Case& test, U32 sessions, unsigned int threads)
+{
+	Iso7816Synthesiser::Config synthesis;
+	synthesis.seed = 11;
+	synthesis.protocol = test.protocol;
+	synthesis.recordClk = test.recordClk;
+	synthesis.inverse = test.inverse;
+	synthesis.parityErrors = test.parityErrors;
+	synthesis.sessions = test.sessions != 0 ? test.sessions : sessions;
+	synthesis.exchanges = test.exchanges;
+
+	Iso7816Synthesiser::MemorySink sink;
+	U64 lastSample = sink.Generate(*Iso7816Synthesiser::factory(synthesis));
+	sink.Cut(static_cast<U64>(lastSample * test.cut));
+
+	// every call gives cursors of their own over the same edges
+	Iso7816ParallelDecoder::ChannelProvider provider = [&sink](Iso7816ParallelDecoder::Channels& channels)
+	{
+		channels.io = sink.OpenLine(EdgeCapture::IO_LINE);
+		channels.reset = sink.OpenLine(EdgeCapture::RST_LINE);
+		channels.vcc = sink.OpenLine(EdgeCapture::VCC_LINE);
+		channels.clk = sink.OpenLine(EdgeCapture::CLK_LINE);
+		return true;
+	};
+
+	Iso7816Engine::Config config;
+	config.ioChannelIndex = EdgeCapture::IO_LINE;
+	config.resetChannelIndex = EdgeCapture::RST_LINE;
+	config.sampleRate = synthesis.sampleRate;
+	config.clkFrequency = 0;
+	config.etu = 0;
+
+	Iso7816ParallelDecoder::Channels channels;
+	provider(channels);
+	RecordingOutput::ptr serial(new RecordingOutput());
+	Iso7816Engine::factory(Iso7816BitDecoder::factory(channels.io, channels.reset, channels.vcc, channels.clk), serial, config)->Run();
+
+	RecordingOutput::ptr parallel(new RecordingOutput());
+	if (!Iso7816ParallelDecoder::factory(provider, parallel, config, threads)->Run())
+	{
+		std::cerr << "FAILED: " << test.name << ", parallel decoding did not run" << std::endl;
+		return false;
+	}
+
+	std::size_t count = std::min(serial->entries.size(), parallel->entries.size());
+	for (std::size_t i = 0; i < count; i++)
+	{
+		if (serial->entries[i] != parallel->entries[i])
+		{
+			std::cerr << "FAILED: " << test.name << ", entry " << i << " differs" << std::endl
+				<< "  serial:   " << serial->entries[i] << std::endl
+				<< "  parallel: " << parallel->entries[i] << std::endl;
+			return false;
+		}
+	}
+	if (serial->entries.size() != parallel->entries.size())
+	{
+		std::cerr << "FAILED: " << test.name << ", " << serial->entries.size() << " entries serially, " << parallel->entries.size() << " in parallel" << std::endl;
+		return false;
+	}
+	std::cerr << "passed: " << test.name << ", " << count << " entries" << std::endl;
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	U32 sessions = 12;
+	unsigned int threads = 4;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "-sessions" && i + 1 < argc) sessions = static_cast<U32>(std::strtoul(argv[++i], nullptr, 10));
+		else if (arg == "-threads" && i + 1 < argc) threads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+		else
+		{
+			std::cerr << "usage: iso7816paralleltest [-sessions n] [-threads n]" << std::endl;
+			return 2;
+		}
+	}
+
+	const Case cases[] =
+	{
+		{ "T=0", 0, true, false, 0, 0, 8, 0.0 },
+		{ "T=1", 1, true, false, 0, 0, 8, 0.0 },
+		{ "T=1 without CLK", 1, false, false, 0, 0, 8, 0.0 },
+		{ "T=0 inverse with parity errors", 0, true, true, 2000, 0, 8, 0.0 },
+		{ "T=1 long session", 1, true, false, 0, 1, 400, 0.0 },
+		{ "T=1 joined after the reset", 1, true, false, 0, 3, 40, 0.2 },
+	};
+	bool passed = true;
+	for (const Case& test : cases)
+	{
+		passed = RunCase(test, sessions, threads) && passed;
+	}
+	return passed ? 0 : 1;
+}
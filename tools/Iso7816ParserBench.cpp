@@ -0,0 +1,167 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+// Measures the parsers the session runs for every byte and frame: ATR, PPS and T=1 blocks.
+// Every case is one CSV line with the time and the heap allocations per call:
+//
+//   iso7816parserbench [-bytes n] [-o results.csv]
+//
+// -bytes sets how many bytes every case parses, 20000000 by default.
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "AllocationCounter.h"
+#include "Definitions.hpp"
+#include "ISO7816Atr.hpp"
+#include "ISO7816Pps.hpp"
+#include "T1Frame.h"
+
+// results are kept here, so the calls are not optimised away
+static volatile std::size_t sink = 0;
+
+template <class Call>
+static void Measure(std::ostream& out, const char* component, const char* name, std::size_t bytes, U64 totalBytes, Call call)
+{
+	U64 iterations = std::max<U64>(1000, totalBytes / bytes);
+	call();
+
+	AllocationCounter::Counts snapshot = AllocationCounter::Get();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (U64 i = 0; i < iterations; i++)
+	{
+		call();
+	}
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	AllocationCounter::Counts allocations = AllocationCounter::Since(snapshot);
+
+	out << component << ',' << name << ',' << bytes << ',' << iterations << ',' << ns / iterations << ',' << ns / iterations / bytes << ','
+		<< static_cast<double>(allocations.allocations) / iterations << ',' << static_cast<double>(allocations.bytes) / iterations << std::endl;
+}
+
+// the way the session feeds the ATR parser: byte after byte, with the name of every element
+static void ParseAtr(const std::vector<U8>& atr)
+{
+	ISO7816Atr::ptr parser = ISO7816Atr::factory();
+	for (U8 b : atr)
+	{
+		parser->PushData(b);
+		sink += parser->GetLastElementName().size();
+		if (parser->Completed()) break;
+	}
+}
+
+static ISO7816Atr::ptr CompleteAtr(const std::vector<U8>& atr)
+{
+	ISO7816Atr::ptr parser = ISO7816Atr::factory();
+	for (U8 b : atr)
+	{
+		parser->PushData(b);
+	}
+	return parser;
+}
+
+// request and response, as the session checks them once all the bytes are there
+static void ParsePps(const std::vector<U8>& exchange)
+{
+	int res = ISO7816Pps::IsPpsFrame(exchange, 0);
+	ISO7816Pps::ptr request = ISO7816Pps::DecodeFrame(exchange, 0);
+	int res2 = ISO7816Pps::IsPpsFrame(exchange, res);
+	ISO7816Pps::ptr response = ISO7816Pps::DecodeFrame(exchange, res);
+	sink += res2 + (request->Equal(response) ? 1 : 0);
+}
+
+static void ParseBlock(T1Frame& block, const std::vector<U8>& data)
+{
+	for (U8 b : data)
+	{
+		block.PushData(b);
+	}
+	sink += block.Completed() ? 1 : 0;
+	block.Clear();
+}
+
+static std::vector<U8> MakeBlock(U8 pcb, std::size_t length)
+{
+	std::vector<U8> block = { 0x00, pcb, static_cast<U8>(length) };
+	for (std::size_t i = 0; i < length; i++)
+	{
+		block.push_back(static_cast<U8>(i * 37 + 11));
+	}
+	U8 lrc = 0;
+	for (U8 b : block)
+	{
+		lrc ^= b;
+	}
+	block.push_back(lrc);
+	return block;
+}
+
+int main(int argc, char* argv[])
+{
+	U64 totalBytes = 20000000;
+	std::string outputPath;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "-bytes" && i + 1 < argc) totalBytes = std::strtoull(argv[++i], nullptr, 10);
+		else if (arg == "-o" && i + 1 < argc) outputPath = argv[++i];
+		else
+		{
+			std::cerr << "usage: iso7816parserbench [-bytes n] [-o results.csv]" << std::endl;
+			return 2;
+		}
+	}
+
+	std::ofstream file;
+	if (!outputPath.empty())
+	{
+		file.open(outputPath.c_str(), std::ios::out | std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cerr << "cannot write " << outputPath << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = file.is_open() ? static_cast<std::ostream&>(file) : std::cout;
+
+	// the ATRs of Test/AtrParser.cpp and the T=1 one of the synthesiser
+	const std::vector<U8> atrT0T1 = { 0x3B, 0x9E, 0x96, 0x80, 0x1F, 0xC7, 0x80, 0x31, 0xE0, 0x73, 0xFE, 0x21, 0x1B, 0x66, 0xD0, 0x01, 0x6C, 0xCF, 0x0D, 0x00, 0xAF };
+	const std::vector<U8> atrT0 = { 0x3B, 0xE2, 0x00, 0x00, 0x40, 0x20, 0x49, 0x05 };
+	const std::vector<U8> atrT1 = { 0x3B, 0x90, 0x95, 0x91, 0x81, 0xB1, 0xFE, 0x55, 0x1F, 0xC7, 0xD7 };
+	const std::vector<U8> atrSynthetic = { 0x3B, 0x98, 0x13, 0x81, 0x31, 0xFE, 0x45, 0x28, 0x32, 0x5A, 0x49, 0x58, 0x5B, 0x59, 0x64, 0xB7 };
+	const std::vector<U8> pps = { PPS_HEADER, 0x11, 0x13, 0xFD, PPS_HEADER, 0x11, 0x13, 0xFD };
+	const std::vector<U8> iBlock = MakeBlock(0x00, 254);
+	const std::vector<U8> sBlock = MakeBlock(0xC1, 1);
+
+	out << "component,case,bytes,iterations,ns_per_call,ns_per_byte,allocations_per_call,allocated_bytes_per_call" << std::endl;
+
+	Measure(out, "ATR", "PushData T=0/T=1", atrT0T1.size(), totalBytes, [&]() { ParseAtr(atrT0T1); });
+	Measure(out, "ATR", "PushData T=0", atrT0.size(), totalBytes, [&]() { ParseAtr(atrT0); });
+	Measure(out, "ATR", "PushData T=1", atrT1.size(), totalBytes, [&]() { ParseAtr(atrT1); });
+	Measure(out, "ATR", "PushData synthetic", atrSynthetic.size(), totalBytes, [&]() { ParseAtr(atrSynthetic); });
+	ISO7816Atr::ptr atr = CompleteAtr(atrT0T1);
+	Measure(out, "ATR", "ToString T=0/T=1", atrT0T1.size(), totalBytes, [&]() { sink += atr->ToString().size(); });
+
+	Measure(out, "PPS", "IsPpsFrame/DecodeFrame exchange", pps.size(), totalBytes, [&]() { ParsePps(pps); });
+
+	T1Frame block;
+	Measure(out, "T=1", "PushData I-block 254", iBlock.size(), totalBytes, [&]() { ParseBlock(block, iBlock); });
+	Measure(out, "T=1", "PushData S-block IFS", sBlock.size(), totalBytes, [&]() { ParseBlock(block, sBlock); });
+	for (U8 b : iBlock)
+	{
+		block.PushData(b);
+	}
+	Measure(out, "T=1", "ToString I-block 254", iBlock.size(), totalBytes, [&]() { sink += block.ToString().size(); });
+	return 0;
+}
@@ -0,0 +1,97 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+// Writes a synthetic edge capture of complete card sessions, the same options give the same capture:
+//
+//   iso7816synth [options] capture
+//
+//   -seed n        random seed (1)
+//   -sessions n    resets in the capture (1)
+//   -exchanges n   command / response pairs in a session (16)
+//   -payload n     maximum data bytes of a command or a response (64)
+//   -t 0|1         protocol (1)
+//   -ta1 hh        TA1 in hex, negotiated by PPS (13)
+//   -tc1 hh        TC1 in hex, extra guard time (not sent)
+//   -nota1         no TA1
+//   -notd1         no TD1, T=0 only
+//   -nopps         no PPS, the default ETU stays
+//   -inverse       inverse convention
+//   -rate Hz       sample rate (24000000)
+//   -clk Hz        CLK frequency (3571200)
+//   -noclk         CLK not recorded
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "Iso7816Synthesiser.h"
+
+static bool ParseOptions(int argc, char* argv[], Iso7816Synthesiser::Config& config, std::string& path)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (arg == "-nota1") config.hasTa1 = false;
+		else if (arg == "-notd1") config.hasTd1 = false;
+		else if (arg == "-nopps") config.pps = false;
+		else if (arg == "-inverse") config.inverse = true;
+		else if (arg == "-noclk") config.recordClk = false;
+		else if (arg[0] != '-')
+		{
+			if (!path.empty()) return false;
+			path = arg;
+		}
+		else if (value == nullptr) return false;
+		else
+		{
+			i++;
+			if (arg == "-seed") config.seed = static_cast<U32>(std::strtoul(value, nullptr, 10));
+			else if (arg == "-sessions") config.sessions = static_cast<U32>(std::strtoul(value, nullptr, 10));
+			else if (arg == "-exchanges") config.exchanges = static_cast<U32>(std::strtoul(value, nullptr, 10));
+			else if (arg == "-payload") config.maxPayload = static_cast<U32>(std::strtoul(value, nullptr, 10));
+			else if (arg == "-t") config.protocol = static_cast<U32>(std::strtoul(value, nullptr, 10));
+			else if (arg == "-ta1") config.ta1 = static_cast<U8>(std::strtoul(value, nullptr, 16));
+			else if (arg == "-tc1")
+			{
+				config.hasTc1 = true;
+				config.tc1 = static_cast<U8>(std::strtoul(value, nullptr, 16));
+			}
+			else if (arg == "-rate") config.sampleRate = std::strtoull(value, nullptr, 10);
+			else if (arg == "-clk") config.clkFrequency = static_cast<U32>(std::strtoul(value, nullptr, 10));
+			else return false;
+		}
+	}
+	// endless generation does not fit into a file
+	return !path.empty() && config.sessions != 0 && config.sampleRate != 0 && config.clkFrequency != 0;
+}
+
+int main(int argc, char* argv[])
+{
+	Iso7816Synthesiser::Config config;
+	std::string path;
+	if (!ParseOptions(argc, argv, config, path))
+	{
+		std::cerr << "usage: iso7816synth [-seed n] [-sessions n] [-exchanges n] [-payload n] [-t 0|1] [-ta1 hh] [-tc1 hh]" << std::endl
+			<< "                    [-nota1] [-notd1] [-nopps] [-inverse] [-rate Hz] [-clk Hz] [-noclk] capture" << std::endl;
+		return 2;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Iso7816Synthesiser::ptr synthesiser = Iso7816Synthesiser::factory(config);
+	if (!synthesiser->WriteCapture(path))
+	{
+		std::cerr << "cannot write " << path << std::endl;
+		return 1;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << path << " written in " << seconds << " s" << std::endl;
+	return 0;
+}
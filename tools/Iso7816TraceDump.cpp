@@ -0,0 +1,96 @@
+//
+// Copyright © 2017 Adam Augustyn <adam@augustyn.net>, all rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at:
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+//
+
+// Turns binary trace snapshots into text, one record per line:
+//
+//   iso7816tracedump [-e event] [-from sample] [-to sample] snapshot...
+//
+// Snapshots come from iso7816batch -t or from the analyzer when ISO7816_TRACE names a file.
+// -e keeps records of the event only, the name as printed ("character", "parity error", ...).
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "TraceBuffer.h"
+
+struct Options
+{
+	std::string event;		// empty for all of them
+	U64 from = 0;
+	U64 to = ~0ULL;
+	std::vector<std::string> snapshots;
+};
+
+static bool ParseOptions(int argc, char* argv[], Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "-e" && hasValue)
+		{
+			options.event = argv[++i];
+		}
+		else if (arg == "-from" && hasValue)
+		{
+			options.from = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "-to" && hasValue)
+		{
+			options.to = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (!arg.empty() && arg[0] == '-')
+		{
+			return false;
+		}
+		else
+		{
+			options.snapshots.push_back(arg);
+		}
+	}
+	return !options.snapshots.empty();
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		std::cerr << "usage: iso7816tracedump [-e event] [-from sample] [-to sample] snapshot..." << std::endl;
+		return 2;
+	}
+
+	int failed = 0;
+	for (const std::string& path : options.snapshots)
+	{
+		std::vector<TraceBuffer::Record> records;
+		if (!TraceBuffer::ReadSnapshot(path, records))
+		{
+			std::cerr << "not a readable trace: " << path << std::endl;
+			failed++;
+			continue;
+		}
+		if (options.snapshots.size() > 1)
+		{
+			std::cout << "# " << path << ", " << records.size() << " records\n";
+		}
+		for (const TraceBuffer::Record& record : records)
+		{
+			if (record.position < options.from || record.position > options.to)
+				continue;
+			if (!options.event.empty() && options.event != TraceBuffer::GetEventName(record.event))
+				continue;
+			std::cout << TraceBuffer::Describe(record) << '\n';
+		}
+	}
+	std::cout.flush();
+	return failed == 0 ? 0 : 1;
+}